@@ -2,248 +2,1279 @@
 #include <stdio.h>
 #include <string.h>
 #include "esp_log.h"
-#include <queue>
-#include <bitset>
+#include "dhc_static_tables.h"
+#include "dhc_file_io.h"
+#include "dhc_batch.h"
+#include "dhc_stream.h"
+#include "dhc_kernels.h"
+#include "dhc_predictor.h"
+#include "dhc_rice.h"
+#include "dhc_stats.h"
+#include <algorithm>
 #include <vector>
 
 #define TAG "DHC"
 
-// Custom comparator for priority queue
-struct CompareNodes {
-    bool operator()(const std::shared_ptr<HuffmanNode>& a, const std::shared_ptr<HuffmanNode>& b) {
-        return a->frequency > b->frequency;
-    }
+// Multi-byte header fields are big-endian
+static inline void writeU16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value & 0xFF);
+}
+
+static inline void writeU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>((value >> 24) & 0xFF);
+    out[1] = static_cast<uint8_t>((value >> 16) & 0xFF);
+    out[2] = static_cast<uint8_t>((value >> 8) & 0xFF);
+    out[3] = static_cast<uint8_t>(value & 0xFF);
+}
+
+static inline uint16_t readU16(const uint8_t* in) {
+    return static_cast<uint16_t>((in[0] << 8) | in[1]);
+}
+
+static inline uint32_t readU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// Encoder scratch arrays; all of them live in one workspace buffer
+struct DHC::Workspace {
+    size_t capacity;         // samples per block
+    int16_t* deltas;
+    uint8_t* symbols;        // alphabet symbol of every delta
+    uint32_t* frequencies;   // this and the arrays below have one entry per alphabet symbol
+    uint32_t* weights;       // frequencies sorted for code length computation
+    uint8_t* lengths;
+    HuffmanCode* codes;      // length 0 for symbols without a code
+    uint8_t* order;          // coded symbols in canonical order
+
+    size_t samples;
+    unsigned lane;           // selects the kept table and the sample coder
+    size_t distinct;         // symbols with a code
+    uint8_t maxLength;
+    uint64_t payloadBits;
+    uint8_t blockType;       // how the block is coded, one of the BLOCK_* types
+    uint8_t predictor;       // order of the residuals in deltas
+    uint8_t riceParameter;   // for BLOCK_RICE
+    const StaticCoder* staticCoder;  // for BLOCK_STATIC
+    const HuffmanCode* payloadCodes;  // codes of the payload: own, kept or static table
 };
 
+template <typename T>
+static T* carveArray(uintptr_t& cursor, size_t count) {
+    cursor = (cursor + alignof(T) - 1) & ~static_cast<uintptr_t>(alignof(T) - 1);
+    T* array = reinterpret_cast<T*>(cursor);
+    cursor += count * sizeof(T);
+    return array;
+}
+
 // Implementation of the DHC class
 DHC::DHC() {
+    sampleCoders[0] = dhcSampleCoder(SAMPLE_DEFAULT, 0);
 }
 
 DHC::~DHC() {
 }
 
-std::vector<int16_t> DHC::computeDeltaValues(const std::vector<uint16_t>& data) {
-    std::vector<int16_t> deltaValues(data.size());
-    deltaValues[0] = static_cast<int16_t>(data[0]);
-    
-    for (size_t i = 1; i < data.size(); i++) {
-        deltaValues[i] = static_cast<int16_t>(data[i]) - static_cast<int16_t>(data[i-1]);
+size_t DHC::layoutWorkspace(uintptr_t base, size_t block_samples, Workspace* ws) {
+    Workspace layout;
+    uintptr_t cursor = base;
+    layout.capacity = block_samples;
+    layout.frequencies = carveArray<uint32_t>(cursor, DHC_ALPHABET_SIZE);
+    layout.weights = carveArray<uint32_t>(cursor, DHC_ALPHABET_SIZE);
+    layout.codes = carveArray<HuffmanCode>(cursor, DHC_ALPHABET_SIZE);
+    layout.lengths = carveArray<uint8_t>(cursor, DHC_ALPHABET_SIZE);
+    layout.order = carveArray<uint8_t>(cursor, DHC_ALPHABET_SIZE);
+    // Per-sample arrays last, so no alignment gap depends on the block size
+    // and every block size needs more bytes than the one before
+    layout.deltas = carveArray<int16_t>(cursor, block_samples);
+    layout.symbols = carveArray<uint8_t>(cursor, block_samples);
+    if (ws) *ws = layout;
+
+    // Room for aligning an arbitrary base pointer
+    return cursor - base + alignof(HuffmanCode);
+}
+
+size_t DHC::workspace_size(size_t block_samples) {
+    if (block_samples == 0) block_samples = 1;
+    if (block_samples > MAX_BLOCK_SAMPLES) block_samples = MAX_BLOCK_SAMPLES;
+    return layoutWorkspace(0, block_samples, nullptr);
+}
+
+size_t DHC::workspaceCapacity(size_t workspace_bytes) {
+    // Largest block whose workspace fits, by binary search
+    size_t low = 0;
+    size_t high = MAX_BLOCK_SAMPLES;
+    while (low < high) {
+        size_t mid = (low + high + 1) / 2;
+        if (workspace_size(mid) <= workspace_bytes) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
     }
-    return deltaValues;
+    return low;
 }
 
-std::vector<uint16_t> DHC::reconstructFromDelta(const std::vector<int16_t>& deltaValues) {
-    std::vector<uint16_t> originalData(deltaValues.size());
-    int32_t accumulator = deltaValues[0];
-    originalData[0] = static_cast<uint16_t>(accumulator);
-    
-    for (size_t i = 1; i < deltaValues.size(); i++) {
-        accumulator += deltaValues[i];
-        originalData[i] = static_cast<uint16_t>(accumulator);
+void DHC::computeDeltaValues(const DhcSampleCoder& samples, const uint8_t* input, size_t first, size_t count,
+                             size_t stride, uint16_t previous, unsigned order, int16_t* deltaValues) {
+    if (samples.native && order == 1 && stride == 1) {
+        dhcKernels().delta(input + first * sizeof(uint16_t), count, previous, deltaValues);
+    } else {
+        samples.predict(input, first, count, stride, previous, order, deltaValues);
     }
-    return originalData;
 }
 
-void DHC::generateCodes(const std::shared_ptr<HuffmanNode>& node, std::string code,
-                       std::unordered_map<int16_t, std::string>& codes) {
-    if (!node) return;
-    
-    if (!node->left && !node->right) {
-        codes[node->value] = code;
+void DHC::reconstructFromDelta(const DhcSampleCoder& samples, const int16_t* deltaValues, size_t count,
+                               uint16_t previous, unsigned order, uint8_t* output, size_t first, size_t stride) {
+    if (samples.native && order == 1 && stride == 1) {
+        dhcKernels().prefixSum(deltaValues, count, previous, output + first * sizeof(uint16_t));
+    } else {
+        samples.unpredict(deltaValues, count, previous, order, output, first, stride);
     }
-    
-    generateCodes(node->left, code + "0", codes);
-    generateCodes(node->right, code + "1", codes);
 }
 
-std::unordered_map<int16_t, std::string> DHC::buildHuffmanCodes(const std::vector<int16_t>& deltaValues) {
-    // Calculate frequencies
-    std::unordered_map<int16_t, size_t> frequencies;
-    for (const auto& value : deltaValues) {
-        frequencies[value]++;
+bool DHC::set_predictor(unsigned order) {
+    if (order > DHC_MAX_PREDICTOR_ORDER && order != PREDICTOR_AUTO) {
+        ESP_LOGE(TAG, "Invalid predictor order: %u", order);
+        return false;
     }
+    predictorSetting = order;
+    return true;
+}
 
-    // Handle case where all values are the same
-    if (frequencies.size() == 1) {
-        auto value = frequencies.begin()->first;
-        return {{value, "0"}};
+bool DHC::set_file_buffer(size_t bytes, bool background_io) {
+    if (bytes < BLOCK_HEADER_SIZE) {
+        ESP_LOGE(TAG, "File buffer too small: %u bytes", static_cast<unsigned>(bytes));
+        return false;
     }
+    fileBufferSize = bytes;
+    fileBackgroundIo = background_io;
+    return true;
+}
 
-    // Create priority queue
-    std::priority_queue<std::shared_ptr<HuffmanNode>, 
-                       std::vector<std::shared_ptr<HuffmanNode>>, 
-                       CompareNodes> pq;
+#if DHC_STATS
+void DHC::noteHeap(size_t extra) {
+    size_t held = ownWorkspace.capacity() + blockBuffer.capacity() +
+                  (blockDeltas.capacity() + decodedSamples.capacity()) * sizeof(uint16_t) + extra;
+    DHC_STATS_MAX(stats.heapHighWater, held);
+}
 
-    // Add nodes to priority queue
-    for (const auto& pair : frequencies) {
-        pq.push(std::make_shared<HuffmanNode>(pair.first, pair.second));
+void DHC::noteBlock(const Workspace& ws, size_t block_size) {
+    stats.blocks++;
+    stats.bytesIn += ws.samples * sampleCoders[ws.lane % samplePlanes]->bits / 8;
+    stats.bytesOut += block_size;
+    if (ws.blockType == BLOCK_DYNAMIC) {
+        stats.tableBytes += 1 + 2 * ws.maxLength + ws.distinct;
+        DHC_STATS_MAX(stats.longestCode, ws.maxLength);
+    } else if (ws.blockType == BLOCK_STATIC) {
+        DHC_STATS_MAX(stats.longestCode, static_cast<uint8_t>(ws.staticCoder->table.maxLength()));
+    }
+}
+#endif
+
+// Bits needed for the deltas counted in frequencies, extra bits included
+static uint64_t payloadBits(const uint32_t* frequencies, const HuffmanCode* codes) {
+    uint64_t bits = 0;
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        bits += static_cast<uint64_t>(frequencies[symbol]) *
+                (codes[symbol].length + dhcAlphabet.symbols[symbol].extraBits);
     }
+    return bits;
+}
 
-    // Build Huffman tree
-    while (pq.size() > 1) {
-        auto left = pq.top(); pq.pop();
-        auto right = pq.top(); pq.pop();
-        
-        auto parent = std::make_shared<HuffmanNode>(0, left->frequency + right->frequency);
-        parent->left = left;
-        parent->right = right;
-        
-        pq.push(parent);
+// Fewer bits than any code table could spend on the same deltas: the entropy
+// of the histogram, with every symbol's information content rounded down
+static uint64_t payloadBitsLowerBound(const uint32_t* frequencies, size_t count) {
+    uint64_t bits = 0;
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        uint32_t frequency = frequencies[symbol];
+        if (frequency == 0) continue;
+        unsigned information = 31 - __builtin_clz(static_cast<uint32_t>(count / frequency));
+        bits += static_cast<uint64_t>(frequency) * (information + dhcAlphabet.symbols[symbol].extraBits);
     }
+    return bits;
+}
 
-    // Generate Huffman codes
-    std::unordered_map<int16_t, std::string> huffmanCodes;
-    if (!pq.empty()) {
-        generateCodes(pq.top(), "", huffmanCodes);
+// Code and extra bits of every delta; the two fit one write of at most 32 bits
+static void writePayload(BitWriter& writer, const int16_t* deltas, const uint8_t* symbols, size_t count,
+                         const HuffmanCode* codes) {
+    for (size_t i = 0; i < count; i++) {
+        const DhcSymbolInfo& info = dhcAlphabet.symbols[symbols[i]];
+        const HuffmanCode& code = codes[symbols[i]];
+        uint32_t extra = static_cast<uint16_t>(deltas[i] - info.base);
+        writer.write((code.code << info.extraBits) | extra, code.length + info.extraBits);
     }
-    
-    return huffmanCodes;
 }
 
-bool DHC::compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
-    if (!input || !output || !output_size || input_size == 0) {
-        ESP_LOGE(TAG, "Invalid input parameters");
+void DHC::classifyDeltas(Workspace& ws) {
+    // The histogram is a flat array over the bounded alphabet
+    memset(ws.frequencies, 0, DHC_ALPHABET_SIZE * sizeof(uint32_t));
+    for (size_t i = 0; i < ws.samples; i++) {
+        uint8_t symbol = dhcDeltaSymbol(ws.deltas[i]);
+        ws.symbols[i] = symbol;
+        ws.frequencies[symbol]++;
+    }
+}
+
+void DHC::buildHuffmanCodes(Workspace& ws) {
+    // Symbols that occur get a code; a table meant for reuse codes all of them,
+    // so that later blocks can never miss it
+    uint8_t* order = ws.order;
+    ws.distinct = 0;
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        ws.codes[symbol] = HuffmanCode{0, 0};
+        if (ws.frequencies[symbol] > 0 || tableReuse) {
+            order[ws.distinct++] = static_cast<uint8_t>(symbol);
+        }
+    }
+
+    // Code lengths from the frequencies, lightest symbol first
+    std::sort(order, order + ws.distinct, [&](uint8_t a, uint8_t b) {
+        return ws.frequencies[a] < ws.frequencies[b];
+    });
+    for (size_t i = 0; i < ws.distinct; i++) {
+        // Unseen symbols still need a code
+        ws.weights[i] = std::max<uint32_t>(ws.frequencies[order[i]], 1);
+    }
+    huffmanCodeLengths(ws.weights, ws.distinct);
+    huffmanLimitCodeLengths(ws.weights, ws.distinct, CODE_LENGTH_LIMIT);
+    ws.maxLength = 0;
+    for (size_t i = 0; i < ws.distinct; i++) {
+        ws.lengths[order[i]] = static_cast<uint8_t>(ws.weights[i]);
+        ws.maxLength = std::max(ws.maxLength, ws.lengths[order[i]]);
+    }
+
+    // Canonical order: by code length, then by symbol
+    const uint8_t* lengths = ws.lengths;
+    std::sort(order, order + ws.distinct, [&](uint8_t a, uint8_t b) {
+        return lengths[a] != lengths[b] ? lengths[a] < lengths[b] : a < b;
+    });
+
+    // Canonical codes: consecutive values within a length, left-shifted between lengths
+    uint32_t code = 0;
+    uint8_t length = lengths[order[0]];
+    for (size_t i = 0; i < ws.distinct; i++) {
+        uint8_t symbol = order[i];
+        code <<= (lengths[symbol] - length);
+        length = lengths[symbol];
+        ws.codes[symbol] = HuffmanCode{code++, length};
+    }
+    ws.payloadBits = payloadBits(ws.frequencies, ws.codes);
+    ws.payloadCodes = ws.codes;
+}
+
+bool DHC::reuseHuffmanCodes(Workspace& ws, const KeptTable& kept) {
+    // The kept table codes every symbol; rebuild once it has drifted too far
+    // from what it achieved on its own block
+    uint64_t bits = payloadBits(ws.frequencies, kept.codes);
+    if (bits * 256 * 100 > kept.bitsPerSample * ws.samples * (100 + reuseDriftPercent)) {
         return false;
     }
+    ws.payloadBits = bits;
+    ws.payloadCodes = kept.codes;
+    ws.blockType = BLOCK_REUSE;
+    return true;
+}
 
-    // Convert input to uint16_t vector
-    std::vector<uint16_t> data(input_size / 2);
-    memcpy(data.data(), input, input_size);
+void DHC::prepareHuffmanCodes(Workspace& ws) {
+    KeptTable* kept = tableReuse ? &keptTables[ws.lane] : nullptr;
+    if (kept && kept->valid && reuseHuffmanCodes(ws, *kept)) {
+        return;
+    }
+    ws.blockType = BLOCK_DYNAMIC;
+    buildHuffmanCodes(ws);
+    if (kept) {
+        memcpy(kept->codes, ws.codes, sizeof(kept->codes));
+        kept->bitsPerSample = ws.payloadBits * 256 / ws.samples;
+        kept->valid = true;
+    }
+}
 
-    // Compute delta values
-    std::vector<int16_t> deltaValues = computeDeltaValues(data);
-    lastDeltaValues = deltaValues;
+void DHC::chooseSharedCodes(Workspace& ws) {
+    // A table of the block's own saves at most what the shared codes spend
+    // above the entropy, and costs at least its length counts and symbols
+    uint64_t sharedBits = payloadBits(ws.frequencies, sharedCodes);
+    size_t distinct = DHC_ALPHABET_SIZE - std::count(ws.frequencies, ws.frequencies + DHC_ALPHABET_SIZE, 0u);
+    if (sharedBits > payloadBitsLowerBound(ws.frequencies, ws.samples) + 8 * (3 + distinct)) {
+        ws.blockType = BLOCK_DYNAMIC;
+        buildHuffmanCodes(ws);
+        if (encodedBlockSize(ws) < BLOCK_HEADER_SIZE + (sharedBits + 7) / 8) {
+            return;
+        }
+    }
+    ws.blockType = BLOCK_REUSE;
+    ws.payloadCodes = sharedCodes;
+    ws.payloadBits = sharedBits;
+}
 
-    // Build Huffman codes
-    auto huffmanCodes = buildHuffmanCodes(deltaValues);
-    lastHuffmanCodes = huffmanCodes;
+void DHC::set_table_reuse(bool enable, unsigned drift_percent) {
+    tableReuse = enable;
+    reuseDriftPercent = drift_percent;
+    keptTables.resize(tableReuse ? lanes() : 0);
+    resetTableReuse();
+}
+
+bool DHC::set_channels(unsigned channels) {
+    if (channels == 0 || channels > MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Invalid channel count: %u", channels);
+        return false;
+    }
+    channelCount = channels;
+    keptTables.resize(tableReuse ? lanes() : 0);
+    resetTableReuse();
+    return true;
+}
+
+bool DHC::set_sample_format(uint8_t format) {
+    unsigned planes = dhcSamplePlanes(format);
+    const DhcSampleCoder* coders[DHC_MAX_SAMPLE_PLANES] = {};
+    for (unsigned plane = 0; plane < planes; plane++) {
+        coders[plane] = dhcSampleCoder(format, plane);
+        if (!coders[plane]) {
+            ESP_LOGE(TAG, "Unsupported sample format: 0x%02X", format);
+            return false;
+        }
+    }
+    sampleFormat = format;
+    samplePlanes = planes;
+    memcpy(sampleCoders, coders, sizeof(sampleCoders));
+    keptTables.resize(tableReuse ? lanes() : 0);
+    resetTableReuse();
+    return true;
+}
+
+void DHC::resetTableReuse() {
+    for (KeptTable& kept : keptTables) {
+        kept.valid = false;
+    }
+    for (ChannelDecoder& channel : channelDecoders) {
+        channel.ready = false;
+    }
+}
+
+size_t DHC::loadSharedTable(const uint8_t* input, size_t size, unsigned lanes) {
+    size_t tableBytes = readCodeTable(input, size, blockTable);
+    ChannelDecoder shared;
+    if (tableBytes == 0 || !(shared.ready = shared.decoder.build(blockTable))) {
+        ESP_LOGE(TAG, "Invalid code table");
+        return 0;
+    }
+    channelDecoders.assign(lanes, shared);
+    return tableBytes;
+}
+
+bool DHC::loadBlockTable(const uint8_t* input, size_t size, unsigned channel) {
+    if (size < BLOCK_HEADER_SIZE || (input[8] & BLOCK_TYPE_MASK) != BLOCK_DYNAMIC ||
+        readCodeTable(input + BLOCK_HEADER_SIZE, size - BLOCK_HEADER_SIZE, blockTable) == 0) {
+        ESP_LOGE(TAG, "Invalid code table");
+        return false;
+    }
+    if (channelDecoders.size() <= channel) {
+        channelDecoders.resize(channel + 1);
+    }
+    ChannelDecoder& own = channelDecoders[channel];
+    own.ready = own.decoder.build(blockTable);
+    return own.ready;
+}
+
+size_t DHC::encodedBlockSize(const Workspace& ws) const {
+    // Static and Rice blocks carry a single parameter byte instead of a table
+    size_t tableSize = 1;
+    if (ws.blockType == BLOCK_DYNAMIC) {
+        tableSize = 1 + 2 * ws.maxLength + ws.distinct;
+    } else if (ws.blockType == BLOCK_REUSE) {
+        tableSize = 0;
+    }
+    return BLOCK_HEADER_SIZE + tableSize + (ws.payloadBits + 7) / 8;
+}
 
-    // Write magic number
+size_t DHC::writeCodeTable(const Workspace& ws, uint8_t* output) const {
+    // Max length, number of codes per length, symbols in canonical order
     size_t pos = 0;
-    output[pos++] = static_cast<uint8_t>(MAGIC >> 8);
-    output[pos++] = static_cast<uint8_t>(MAGIC & 0xFF);
+    output[pos++] = ws.maxLength;
+    uint8_t* lengthCounts = output + pos;
+    memset(lengthCounts, 0, 2 * ws.maxLength);
+    pos += 2 * ws.maxLength;
+    for (size_t i = 0; i < ws.distinct; i++) {
+        uint8_t symbol = ws.order[i];
+        uint8_t* count = lengthCounts + 2 * (ws.lengths[symbol] - 1);
+        writeU16(count, readU16(count) + 1);
+        output[pos++] = symbol;
+    }
+    return pos;
+}
+
+size_t DHC::writeBlock(const Workspace& ws, uint8_t* output, size_t capacity) const {
+    if (encodedBlockSize(ws) > capacity) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return 0;
+    }
+
+    DHC_STATS_BEGIN(lap);
+    size_t pos = 0;
+    writeU32(output + pos, static_cast<uint32_t>(ws.samples));
+    pos += 4;
+    writeU32(output + pos, static_cast<uint32_t>((ws.payloadBits + 7) / 8));
+    pos += 4;
+    output[pos++] = blockTypeByte(ws.blockType, ws.predictor);
+
+    // A reused table was already sent with an earlier block
+    if (ws.blockType == BLOCK_DYNAMIC) {
+        pos += writeCodeTable(ws, output + pos);
+    }
+
+    DHC_STATS_LAP(lap, stats.encodeTime);
+
+    // Payload: one table lookup and one register append per sample
+    BitWriter writer(output + pos, capacity - pos);
+    writePayload(writer, ws.deltas, ws.symbols, ws.samples, ws.payloadCodes);
+    pos += writer.flush();
+    DHC_STATS_LAP(lap, stats.packTime);
+    return writer.overflow() ? 0 : pos;
+}
+
+bool DHC::addStaticCoder(uint8_t id, const HuffmanTable& table) {
+    StaticCoder coder;
+    coder.id = id;
+    coder.table = table;
+    if (table.maxLength() > STATIC_TABLE_MAX_LENGTH || !coder.decoder.build(table)) {
+        ESP_LOGE(TAG, "Invalid static table %u", (unsigned)id);
+        return false;
+    }
+
+    // Encoder codes by symbol; a static table has to code the whole alphabet
+    for (HuffmanCode& code : coder.codes) {
+        code = HuffmanCode{0, 0};
+    }
+    uint32_t code = 0;
+    size_t index = 0;
+    for (size_t len = 1; len < table.lengthCounts.size(); len++) {
+        for (uint16_t i = 0; i < table.lengthCounts[len]; i++) {
+            coder.codes[table.symbols[index++]] = HuffmanCode{code++, static_cast<uint8_t>(len)};
+        }
+        code <<= 1;
+    }
+    for (const HuffmanCode& symbolCode : coder.codes) {
+        if (symbolCode.length == 0) {
+            ESP_LOGE(TAG, "Static table %u does not code every symbol", (unsigned)id);
+            return false;
+        }
+    }
+
+    for (StaticCoder& existing : staticCoders) {
+        if (existing.id == id) {
+            existing = std::move(coder);
+            return true;
+        }
+    }
+    staticCoders.push_back(std::move(coder));
+    return true;
+}
+
+const DHC::StaticCoder* DHC::findStaticCoder(uint8_t id) {
+    for (const StaticCoder& coder : staticCoders) {
+        if (coder.id == id) return &coder;
+    }
+
+    // Built-in tables are prepared on first use
+    const StaticTableSpec* spec = dhcFindStaticTable(id);
+    if (!spec) {
+        ESP_LOGE(TAG, "Unknown static table %u", (unsigned)id);
+        return nullptr;
+    }
+    HuffmanTable table;
+    table.lengthCounts.assign(spec->lengthCounts, spec->lengthCounts + spec->maxLength);
+    table.lengthCounts.insert(table.lengthCounts.begin(), 0);
+    table.symbols.assign(spec->symbols, spec->symbols + spec->symbolCount);
+    if (!addStaticCoder(id, table)) {
+        return nullptr;
+    }
+    return &staticCoders.back();
+}
+
+bool DHC::set_static_table(uint8_t table_id) {
+    if (table_id != 0 && !findStaticCoder(table_id)) {
+        return false;
+    }
+    staticTableId = table_id;
+    return true;
+}
+
+bool DHC::load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size) {
+    HuffmanTable parsed;
+    if (table_id == 0 || !table || readCodeTable(table, table_size, parsed) != table_size) {
+        ESP_LOGE(TAG, "Invalid static table");
+        return false;
+    }
+    return addStaticCoder(table_id, parsed);
+}
+
+size_t DHC::writeStaticBlock(const Workspace& ws, uint8_t* output, size_t capacity) const {
+    size_t blockSize = encodedBlockSize(ws);
+    if (blockSize > capacity) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return 0;
+    }
+
+    writeU32(output, static_cast<uint32_t>(ws.samples));
+    writeU32(output + 4, static_cast<uint32_t>(blockSize - BLOCK_HEADER_SIZE - 1));
+    output[8] = blockTypeByte(BLOCK_STATIC, ws.predictor);
+    output[BLOCK_HEADER_SIZE] = ws.staticCoder->id;
 
-    // Write original size
-    uint32_t originalSize = static_cast<uint32_t>(data.size());
-    output[pos++] = static_cast<uint8_t>((originalSize >> 24) & 0xFF);
-    output[pos++] = static_cast<uint8_t>((originalSize >> 16) & 0xFF);
-    output[pos++] = static_cast<uint8_t>((originalSize >> 8) & 0xFF);
-    output[pos++] = static_cast<uint8_t>(originalSize & 0xFF);
+    BitWriter writer(output + BLOCK_HEADER_SIZE + 1, capacity - BLOCK_HEADER_SIZE - 1);
+    writePayload(writer, ws.deltas, ws.symbols, ws.samples, ws.payloadCodes);
+    writer.flush();
+    return writer.overflow() ? 0 : blockSize;
+}
+
+size_t DHC::writeRiceBlock(const Workspace& ws, uint8_t* output, size_t capacity) const {
+    // The payload size is only known once written, saving a pass over the
+    // deltas; a block that does not fit is left to the stored fallback
+    if (capacity < BLOCK_HEADER_SIZE + 1) {
+        return 0;
+    }
+    BitWriter writer(output + BLOCK_HEADER_SIZE + 1, capacity - BLOCK_HEADER_SIZE - 1);
+    riceEncode(writer, ws.deltas, ws.samples, ws.riceParameter);
+    size_t payloadBytes = writer.flush();
+    if (writer.overflow()) {
+        return 0;
+    }
+
+    writeU32(output, static_cast<uint32_t>(ws.samples));
+    writeU32(output + 4, static_cast<uint32_t>(payloadBytes));
+    output[8] = blockTypeByte(BLOCK_RICE, ws.predictor);
+    output[BLOCK_HEADER_SIZE] = ws.riceParameter;
+    return BLOCK_HEADER_SIZE + 1 + payloadBytes;
+}
 
-    // Write compressed data
-    std::vector<bool> bits;
-    for (const auto& value : deltaValues) {
-        const std::string& code = huffmanCodes[value];
-        for (char bit : code) {
-            bits.push_back(bit == '1');
+size_t DHC::writeStoredBlock(const Workspace& ws, uint8_t* output, size_t capacity) const {
+    size_t blockSize = storedBlockSize(ws.samples);
+    if (blockSize > capacity) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return 0;
+    }
+    writeU32(output, static_cast<uint32_t>(ws.samples));
+    writeU32(output + 4, static_cast<uint32_t>(ws.samples * sizeof(int16_t)));
+    output[8] = blockTypeByte(BLOCK_STORED, ws.predictor);
+    uint8_t* payload = output + BLOCK_HEADER_SIZE;
+    if (!DHC_HOST_BIG_ENDIAN) {
+        memcpy(payload, ws.deltas, ws.samples * sizeof(int16_t));
+    } else {
+        for (size_t i = 0; i < ws.samples; i++) {
+            payload[2 * i] = static_cast<uint8_t>(ws.deltas[i]);
+            payload[2 * i + 1] = static_cast<uint8_t>(static_cast<uint16_t>(ws.deltas[i]) >> 8);
         }
     }
+    return blockSize;
+}
 
-    // Pack bits into bytes
-    size_t bytePos = pos;
-    uint8_t currentByte = 0;
-    int bitCount = 0;
+void DHC::useStored(Workspace& ws) {
+    ws.blockType = BLOCK_STORED;
+    ws.payloadBits = static_cast<uint64_t>(ws.samples) * 16;
+}
 
-    for (bool bit : bits) {
-        currentByte = (currentByte << 1) | (bit ? 1 : 0);
-        bitCount++;
-        
-        if (bitCount == 8) {
-            output[bytePos++] = currentByte;
-            currentByte = 0;
-            bitCount = 0;
+size_t DHC::containerHeaderSize() const {
+    return sampleFormat != SAMPLE_DEFAULT ? 4 : channelCount > 1 ? 3 : 2;
+}
+
+size_t DHC::blocksBound(size_t frames, unsigned lanes, size_t block_samples) {
+    if (block_samples == 0 || block_samples > MAX_BLOCK_SAMPLES) block_samples = MAX_BLOCK_SAMPLES;
+    size_t blocks = (frames + block_samples - 1) / block_samples * lanes;
+    return blocks * BLOCK_HEADER_SIZE + frames * lanes * sizeof(int16_t);
+}
+
+size_t DHC::compress_bound(size_t input_size, size_t block_samples) const {
+    size_t frames = dhcSampleCount(sampleFormat, input_size) / channelCount;
+    return containerHeaderSize() + blocksBound(frames, lanes(), block_samples);
+}
+
+void DHC::useRice(Workspace& ws, unsigned k) {
+    // Upper bound, see writeRiceBlock
+    ws.blockType = BLOCK_RICE;
+    ws.riceParameter = static_cast<uint8_t>(k);
+    ws.payloadBits = static_cast<uint64_t>(ws.samples) * (RICE_ESCAPE_QUOTIENT + 16);
+}
+
+void DHC::predictBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                       Workspace& ws) {
+    DHC_STATS_BEGIN(lap);
+    const DhcSampleCoder& samples = *sampleCoders[ws.lane % samplePlanes];
+    ws.samples = count;
+    ws.predictor = static_cast<uint8_t>(predictorSetting != PREDICTOR_AUTO
+                                            ? predictorSetting
+                                            : samples.choosePredictor(input, first, count, stride));
+    computeDeltaValues(samples, input, first, count, stride, previous, ws.predictor, ws.deltas);
+    DHC_STATS_LAP(lap, stats.deltaTime);
+}
+
+size_t DHC::planBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                      Workspace& ws) {
+    predictBlock(input, first, count, stride, previous, ws);
+    DHC_STATS_BEGIN(lap);
+
+    if (staticTableId != 0) {
+        ws.staticCoder = findStaticCoder(staticTableId);
+        if (!ws.staticCoder) return 0;
+        classifyDeltas(ws);
+        DHC_STATS_LAP(lap, stats.histogramTime);
+        ws.blockType = BLOCK_STATIC;
+        ws.payloadCodes = ws.staticCoder->codes;
+        ws.payloadBits = payloadBits(ws.frequencies, ws.payloadCodes);
+        DHC_STATS_LAP(lap, stats.treeTime);
+        if (encodedBlockSize(ws) > storedBlockSize(count)) {
+            useStored(ws);
         }
+        return encodedBlockSize(ws);
+    }
+
+    // Rice alone needs neither a histogram nor a table; a block that would
+    // grow is stored instead as it is written
+    const size_t storedSize = storedBlockSize(count);
+    if (codingEngine == ENGINE_RICE) {
+        useRice(ws, riceParameter(ws.deltas, count));
+        DHC_STATS_LAP(lap, stats.treeTime);
+        return std::min(encodedBlockSize(ws), storedSize);
+    }
+
+    classifyDeltas(ws);
+    DHC_STATS_LAP(lap, stats.histogramTime);
+    uint64_t riceBits = 0;
+    unsigned k = codingEngine == ENGINE_AUTO ? riceEstimate(ws.frequencies, &riceBits) : 0;
+    size_t riceSize = codingEngine == ENGINE_AUTO ? BLOCK_HEADER_SIZE + 1 + (riceBits + 7) / 8 : SIZE_MAX;
+
+    // Noise: when no table could beat storing the residuals, none is built
+    if (riceSize >= storedSize &&
+        BLOCK_HEADER_SIZE + payloadBitsLowerBound(ws.frequencies, count) / 8 >= storedSize) {
+        useStored(ws);
+        DHC_STATS_LAP(lap, stats.treeTime);
+        return storedSize;
+    }
+    if (sharedCodes) {
+        chooseSharedCodes(ws);
+    } else {
+        prepareHuffmanCodes(ws);
     }
+    DHC_STATS_LAP(lap, stats.treeTime);
+    size_t huffmanSize = encodedBlockSize(ws);
+    if (huffmanSize <= storedSize && huffmanSize <= riceSize) {
+        return huffmanSize;
+    }
+    // A table built for this block is never sent, so it cannot be kept
+    if (tableReuse && ws.blockType == BLOCK_DYNAMIC) keptTables[ws.lane].valid = false;
+    if (riceSize > storedSize) {
+        useStored(ws);
+        return storedSize;
+    }
+    useRice(ws, k);
+    return std::min(encodedBlockSize(ws), storedSize);
+}
 
-    // Handle remaining bits
-    if (bitCount > 0) {
-        currentByte <<= (8 - bitCount);
-        output[bytePos++] = currentByte;
+size_t DHC::writePlannedBlock(const Workspace& ws, uint8_t* output, size_t capacity) {
+    // Static and Rice blocks are all payload; writeBlock times its table itself
+    DHC_STATS_BEGIN(lap);
+    size_t blockSize;
+    switch (ws.blockType) {
+    case BLOCK_STATIC:
+        blockSize = writeStaticBlock(ws, output, capacity);
+        DHC_STATS_LAP(lap, stats.packTime);
+        break;
+    case BLOCK_RICE:
+        // Stops at the size of a stored block, which then takes its place
+        blockSize = writeRiceBlock(ws, output, std::min(capacity, storedBlockSize(ws.samples)));
+        if (blockSize == 0) {
+            blockSize = writeStoredBlock(ws, output, capacity);
+        }
+        DHC_STATS_LAP(lap, stats.packTime);
+        break;
+    case BLOCK_STORED:
+        blockSize = writeStoredBlock(ws, output, capacity);
+        DHC_STATS_LAP(lap, stats.packTime);
+        break;
+    default:
+        blockSize = writeBlock(ws, output, capacity);
+        if (blockSize == 0 && tableReuse) {
+            keptTables[ws.lane].valid = false;
+        }
+        break;
     }
+#if DHC_STATS
+    if (blockSize > 0) noteBlock(ws, blockSize);
+#endif
+    return blockSize;
+}
 
-    *output_size = bytePos;
+size_t DHC::compressBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                          unsigned lane, uint8_t* output, size_t capacity, Workspace& ws) {
+    ws.lane = lane;
+    if (planBlock(input, first, count, stride, previous, ws) == 0) {
+        return 0;
+    }
+    return writePlannedBlock(ws, output, capacity);
+}
+
+bool DHC::appendBlock(const uint8_t* input, size_t count, size_t stride, uint16_t previous, unsigned lane,
+                      std::vector<uint8_t>& out) {
+    size_t needed = workspace_size(count);
+    if (ownWorkspace.size() < needed) {
+        ownWorkspace.resize(needed);
+    }
+    Workspace ws;
+    layoutWorkspace(reinterpret_cast<uintptr_t>(ownWorkspace.data()), count, &ws);
+    ws.lane = lane;
+
+    // Exact size, or an upper bound for Rice blocks
+    size_t blockSize = planBlock(input, 0, count, stride, previous, ws);
+    if (blockSize == 0) {
+        return false;
+    }
+    size_t start = out.size();
+    out.resize(start + blockSize);
+    blockSize = writePlannedBlock(ws, out.data() + start, blockSize);
+    out.resize(start + blockSize);
+#if DHC_STATS
+    noteHeap(0);
+#endif
+    return blockSize > 0;
+}
+
+bool DHC::blockLength(const uint8_t* input, size_t available, size_t* length) const {
+    // Fixed header, then the table reference or the length counts, then symbols and payload
+    *length = BLOCK_HEADER_SIZE + 1;
+    if (available < *length) return true;
+    uint32_t sampleCount = readU32(input);
+    uint32_t payloadBytes = readU32(input + 4);
+    uint8_t blockType = input[8] & BLOCK_TYPE_MASK;
+    if ((input[8] >> PREDICTOR_SHIFT) > DHC_MAX_PREDICTOR_ORDER) {
+        return false;
+    }
+    if (sampleCount == 0 || sampleCount > MAX_BLOCK_SAMPLES ||
+        payloadBytes > (static_cast<uint64_t>(sampleCount) * MAX_ENCODE_LENGTH + 7) / 8) {
+        return false;
+    }
+    if (blockType == BLOCK_STATIC || blockType == BLOCK_RICE) {
+        *length += payloadBytes;
+        return true;
+    }
+    if (blockType == BLOCK_STORED) {
+        *length = BLOCK_HEADER_SIZE + payloadBytes;
+        return payloadBytes == sampleCount * sizeof(int16_t);
+    }
+    if (blockType == BLOCK_REUSE) {
+        *length = BLOCK_HEADER_SIZE + payloadBytes;
+        return true;
+    }
+    if (blockType != BLOCK_DYNAMIC) {
+        return false;
+    }
+
+    uint8_t maxLength = input[BLOCK_HEADER_SIZE];
+    if (maxLength == 0) {
+        return false;
+    }
+    *length += 2 * maxLength;
+    if (available < *length) return true;
+    size_t symbolCount = 0;
+    for (size_t len = 0; len < maxLength; len++) {
+        symbolCount += readU16(input + BLOCK_HEADER_SIZE + 1 + 2 * len);
+    }
+    if (symbolCount == 0 || symbolCount > DHC_ALPHABET_SIZE) {
+        return false;
+    }
+
+    *length += symbolCount + payloadBytes;
     return true;
 }
 
-bool DHC::decompress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
-    if (!input || !output || !output_size || input_size < 6) {
-        ESP_LOGE(TAG, "Invalid input parameters");
+bool DHC::block_info(const uint8_t* block, size_t available, BlockInfo* info) const {
+    size_t length;
+    if (!block || !info || !blockLength(block, available, &length) || length > available) {
         return false;
     }
+    info->samples = readU32(block);
+    info->type = block[8] & BLOCK_TYPE_MASK;
+    info->predictor = block[8] >> PREDICTOR_SHIFT;
+    info->payloadBytes = readU32(block + 4);
+    info->tableBytes = length - BLOCK_HEADER_SIZE - info->payloadBytes;
+    info->length = length;
+    return true;
+}
 
-    // Verify magic number
-    uint16_t magic = (input[0] << 8) | input[1];
-    if (magic != MAGIC) {
-        ESP_LOGE(TAG, "Invalid magic number");
+bool DHC::inspect(const uint8_t* input, size_t input_size, ContainerInfo* info) {
+    if (!input || !info || input_size < 2) {
+        return false;
+    }
+    // Magic, then the channel count and sample format where the magic says so
+    uint16_t magic = readU16(input);
+    info->channels = 1;
+    info->sampleFormat = SAMPLE_DEFAULT;
+    info->blocksBegin = 2;
+    info->blocksEnd = input_size;
+    bool channelByte = false;
+    bool formatByte = false;
+    if (magic == MAGIC || magic == CHANNELS_MAGIC || magic == FORMAT_MAGIC) {
+        info->container = CONTAINER_BUFFER;
+        channelByte = magic != MAGIC;
+        formatByte = magic == FORMAT_MAGIC;
+    } else if (magic == DHCStreamEncoder::STREAM_MAGIC || magic == DHCStreamEncoder::STREAM_CHANNELS_MAGIC ||
+               magic == DHCStreamEncoder::STREAM_FORMAT_MAGIC) {
+        info->container = CONTAINER_STREAM;
+        channelByte = magic != DHCStreamEncoder::STREAM_MAGIC;
+        formatByte = magic == DHCStreamEncoder::STREAM_FORMAT_MAGIC;
+    } else if (magic == DHCBatchEncoder::BATCH_MAGIC) {
+        info->container = CONTAINER_BATCH;
+        channelByte = true;
+        formatByte = true;
+    } else if (magic == FILE_MAGIC) {
+        // Blocks end where the seek index starts
+        info->container = CONTAINER_FILE;
+        if (input_size < FILE_HEADER_SIZE + FILE_TRAILER_SIZE ||
+            readU16(input + input_size - 2) != INDEX_MAGIC) {
+            return false;
+        }
+        uint32_t count = readU32(input + input_size - FILE_TRAILER_SIZE);
+        uint32_t indexOffset = readU32(input + input_size - FILE_TRAILER_SIZE + 4);
+        if (indexOffset < FILE_HEADER_SIZE ||
+            static_cast<uint64_t>(indexOffset) + static_cast<uint64_t>(count) * INDEX_ENTRY_SIZE + FILE_TRAILER_SIZE !=
+                input_size) {
+            return false;
+        }
+        info->blocksBegin = FILE_HEADER_SIZE;
+        info->blocksEnd = indexOffset;
+        return true;
+    } else {
+        return false;
+    }
+    if (input_size < static_cast<size_t>(2 + channelByte + formatByte)) {
+        return false;
+    }
+    if (channelByte) {
+        info->channels = input[info->blocksBegin++];
+    }
+    if (formatByte) {
+        info->sampleFormat = input[info->blocksBegin++];
+    }
+    if (info->container == CONTAINER_BATCH) {
+        info->blocksBegin = info->blocksEnd = 0;
+    }
+    return info->channels > 0 && info->channels <= MAX_CHANNELS;
+}
+
+bool DHC::decodeBlock(const uint8_t* input, size_t size, uint16_t previous, unsigned lane,
+                      std::vector<uint16_t>& samples) {
+    size_t length;
+    if (!blockLength(input, size, &length) || length > size) {
+        ESP_LOGE(TAG, "Invalid block header");
+        return false;
+    }
+    samples.resize(readU32(input));
+    return decodeBlock(input, size, previous, lane, reinterpret_cast<uint8_t*>(samples.data()), 1);
+}
+
+bool DHC::decodeBlock(const uint8_t* input, size_t size, uint16_t previous, unsigned lane, uint8_t* output,
+                      size_t stride, const DhcSampleCoder* samples, size_t first) {
+    DHC_STATS_BEGIN(lap);
+    size_t length;
+    if (!blockLength(input, size, &length) || length > size) {
+        ESP_LOGE(TAG, "Invalid block header");
+        return false;
+    }
+    uint32_t sampleCount = readU32(input);
+    uint32_t payloadBytes = readU32(input + 4);
+    uint8_t blockType = input[8] & BLOCK_TYPE_MASK;
+    size_t pos = BLOCK_HEADER_SIZE;
+    if (channelDecoders.size() <= lane) {
+        channelDecoders.resize(lane + 1);
+    }
+    ChannelDecoder& own = channelDecoders[lane];
+    blockDeltas.resize(sampleCount);
+    bool decoded;
+
+    if (blockType == BLOCK_STATIC) {
+        // Table referenced by ID, its decoder is built once
+        const StaticCoder* coder = findStaticCoder(input[pos]);
+        if (!coder) {
+            return false;
+        }
+        BitReader reader(input + pos + 1, payloadBytes);
+        decoded = coder->decoder.decode(reader, blockDeltas.data(), sampleCount);
+    } else if (blockType == BLOCK_RICE) {
+        // Table-free; the kept Huffman decoder stays valid for later reuse blocks
+        BitReader reader(input + pos + 1, payloadBytes);
+        decoded = riceDecode(reader, blockDeltas.data(), sampleCount, input[pos]);
+    } else if (blockType == BLOCK_STORED) {
+        // Residuals as they are
+        const uint8_t* payload = input + pos;
+        if (!DHC_HOST_BIG_ENDIAN) {
+            memcpy(blockDeltas.data(), payload, sampleCount * sizeof(int16_t));
+        } else {
+            for (size_t i = 0; i < sampleCount; i++) {
+                blockDeltas[i] = static_cast<int16_t>(payload[2 * i] | (payload[2 * i + 1] << 8));
+            }
+        }
+        decoded = true;
+    } else if (blockType == BLOCK_REUSE) {
+        // Coded with the channel's previous dynamic block table, the decoder is already built
+        if (!own.ready) {
+            ESP_LOGE(TAG, "Block reuses a table that was never sent");
+            return false;
+        }
+        BitReader reader(input + pos, payloadBytes);
+        decoded = own.decoder.decode(reader, blockDeltas.data(), sampleCount);
+    } else {
+        // Read the code table that describes this block
+        size_t tableBytes = readCodeTable(input + pos, size - pos, blockTable);
+        if (tableBytes == 0) {
+            ESP_LOGE(TAG, "Invalid code table");
+            return false;
+        }
+        pos += tableBytes;
+        BitReader reader(input + pos, payloadBytes);
+        if (keepSharedTable) {
+            decoded = blockDecoder.build(blockTable) && blockDecoder.decode(reader, blockDeltas.data(), sampleCount);
+        } else {
+            own.ready = own.decoder.build(blockTable);
+            decoded = own.ready && own.decoder.decode(reader, blockDeltas.data(), sampleCount);
+        }
+    }
+    if (!decoded) {
+        ESP_LOGE(TAG, "Corrupt compressed data");
+        return false;
+    }
+
+    // Reconstruct original values with the block's predictor
+    if (!samples) samples = dhcSampleCoder(SAMPLE_DEFAULT, 0);
+    reconstructFromDelta(*samples, blockDeltas.data(), sampleCount, previous, input[8] >> PREDICTOR_SHIFT, output,
+                         first, stride);
+    DHC_STATS_LAP(lap, stats.decodeTime);
+#if DHC_STATS
+    stats.blocks++;
+    stats.bytesIn += length;
+    stats.bytesOut += sampleCount * samples->bits / 8;
+    noteHeap(0);
+#endif
+    return true;
+}
+
+size_t DHC::readCodeTable(const uint8_t* input, size_t input_size, HuffmanTable& table) const {
+    if (input_size < 1) return 0;
+    uint8_t maxLength = input[0];
+    size_t pos = 1;
+    if (maxLength == 0 || input_size < pos + 2 * maxLength) return 0;
+
+    table.lengthCounts.assign(maxLength + 1, 0);
+    size_t symbolCount = 0;
+    uint64_t available = 1;  // codes still unassigned at the current length
+    for (size_t len = 1; len <= maxLength; len++) {
+        table.lengthCounts[len] = readU16(input + pos);
+        pos += 2;
+        available = std::min<uint64_t>(available << 1, 1u << 20);
+        if (table.lengthCounts[len] > available) return 0;  // over-subscribed
+        available -= table.lengthCounts[len];
+        symbolCount += table.lengthCounts[len];
+    }
+    if (symbolCount == 0 || symbolCount > DHC_ALPHABET_SIZE || input_size < pos + symbolCount) return 0;
+
+    table.symbols.assign(input + pos, input + pos + symbolCount);
+    pos += symbolCount;
+    for (uint8_t symbol : table.symbols) {
+        if (symbol >= DHC_ALPHABET_SIZE) return 0;
+    }
+    return pos;
+}
+
+bool DHC::compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
+    if (!input || !output || !output_size || input_size == 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
         return false;
     }
 
-    // Read original size
-    uint32_t originalSize = (input[2] << 24) | (input[3] << 16) | (input[4] << 8) | input[5];
-    if (*output_size < originalSize * 2) {
+    // Scratch memory is kept between calls and only grows for larger blocks
+    size_t frames = dhcSampleCount(sampleFormat, input_size) / channelCount;
+    size_t samples = std::min(std::max<size_t>(frames, 1), static_cast<size_t>(MAX_BLOCK_SAMPLES));
+    size_t needed = workspace_size(samples);
+    if (ownWorkspace.size() < needed) {
+        ownWorkspace.resize(needed);
+    }
+    return compress(input, input_size, output, output_size, ownWorkspace.data(), ownWorkspace.size());
+}
+
+bool DHC::compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size,
+                   void* workspace, size_t workspace_bytes) {
+    if (!input || !output || !output_size || input_size == 0 || !workspace) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    // Packed 12-bit samples may end half way into a byte, which must be unused
+    const size_t frames = dhcSampleCount(sampleFormat, input_size) / channelCount;
+    if (frames == 0 || dhcSampleBytes(sampleFormat, frames * channelCount) != input_size) {
+        ESP_LOGE(TAG, "Input is not a whole number of %u-channel frames of %u-bit samples", channelCount,
+                 dhcSampleBits(sampleFormat));
+        return false;
+    }
+    if (!dhcSamplePaddingClear(sampleFormat, input, frames * channelCount)) {
+        ESP_LOGE(TAG, "Unused half of the last byte of 12-bit samples is not zero");
+        return false;
+    }
+    size_t blockSamples = workspaceCapacity(workspace_bytes);
+    if (blockSamples == 0) {
+        ESP_LOGE(TAG, "Workspace too small");
+        return false;
+    }
+    Workspace ws;
+    layoutWorkspace(reinterpret_cast<uintptr_t>(workspace), blockSamples, &ws);
+    resetTableReuse();
+
+    // Write magic number (and channel count, and sample format unless it is
+    // the default), then blocks
+    const bool formatted = sampleFormat != SAMPLE_DEFAULT;
+    size_t pos = containerHeaderSize();
+    if (*output_size < pos) {
         ESP_LOGE(TAG, "Output buffer too small");
         return false;
     }
+    uint16_t magic = formatted ? FORMAT_MAGIC : channelCount > 1 ? CHANNELS_MAGIC : MAGIC;
+    output[0] = static_cast<uint8_t>(magic >> 8);
+    output[1] = static_cast<uint8_t>(magic & 0xFF);
+    if (pos > 2) {
+        output[2] = static_cast<uint8_t>(channelCount);
+    }
+    if (formatted) {
+        output[3] = sampleFormat;
+    }
 
-    // Reconstruct Huffman tree from codes
-    auto huffmanCodes = lastHuffmanCodes;
-    std::shared_ptr<HuffmanNode> root = std::make_shared<HuffmanNode>(0, 0);
-    for (const auto& pair : huffmanCodes) {
-        std::shared_ptr<HuffmanNode> current = root;
-        for (char bit : pair.second) {
-            if (bit == '0') {
-                if (!current->left) {
-                    current->left = std::make_shared<HuffmanNode>(0, 0);
-                }
-                current = current->left;
-            } else {
-                if (!current->right) {
-                    current->right = std::make_shared<HuffmanNode>(0, 0);
-                }
-                current = current->right;
+    size_t blocksSize = compressFrames(input, frames, output + pos, *output_size - pos, ws);
+    if (blocksSize == 0) {
+        return false;
+    }
+#if DHC_STATS
+    noteHeap(0);
+#endif
+
+    *output_size = pos + blocksSize;
+    return true;
+}
+
+size_t DHC::compressFrames(const uint8_t* input, size_t frames, uint8_t* output, size_t capacity, Workspace& ws) {
+    // Every range of frames is written as one block per lane, in channel and
+    // then plane order
+    size_t pos = 0;
+    for (size_t first = 0; first < frames; first += ws.capacity) {
+        size_t count = std::min(ws.capacity, frames - first);
+        for (unsigned lane = 0; lane < lanes(); lane++) {
+            size_t blockSize = compressBlock(input, first * channelCount + lane / samplePlanes, count, channelCount,
+                                             0, lane, output + pos, capacity - pos, ws);
+            if (blockSize == 0) {
+                return 0;
             }
+            pos += blockSize;
         }
-        current->value = pair.first;
     }
+    return pos;
+}
 
-    // Decode bits to delta values
-    std::vector<int16_t> deltaValues;
-    std::shared_ptr<HuffmanNode> current = root;
-    
-    for (size_t i = 6; i < input_size; i++) {
-        std::bitset<8> bits(input[i]);
-        for (int j = 7; j >= 0; j--) {
-            if (bits[j]) {
-                current = current->right;
-            } else {
-                current = current->left;
+void DHC::addRecordHistogram(const uint8_t* input, size_t frames, uint32_t* histogram) {
+    size_t blockSamples = std::min(frames, static_cast<size_t>(MAX_BLOCK_SAMPLES));
+    size_t needed = workspace_size(blockSamples);
+    if (ownWorkspace.size() < needed) {
+        ownWorkspace.resize(needed);
+    }
+    Workspace ws;
+    layoutWorkspace(reinterpret_cast<uintptr_t>(ownWorkspace.data()), blockSamples, &ws);
+
+    // The same ranges and predictors as compressFrames()
+    for (size_t first = 0; first < frames; first += blockSamples) {
+        size_t count = std::min(blockSamples, frames - first);
+        for (unsigned lane = 0; lane < lanes(); lane++) {
+            ws.lane = lane;
+            predictBlock(input, first * channelCount + lane / samplePlanes, count, channelCount, 0, ws);
+            classifyDeltas(ws);
+            for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+                histogram[symbol] += ws.frequencies[symbol];
             }
-            
-            if (!current->left && !current->right) {
-                deltaValues.push_back(current->value);
-                current = root;
-                
-                if (deltaValues.size() == originalSize) {
-                    break;
+        }
+    }
+}
+
+size_t DHC::writeSharedTable(const uint32_t* histogram, HuffmanCode* codes, uint8_t* output, size_t capacity) {
+    // Only the per-symbol arrays of the workspace are used
+    size_t needed = workspace_size(1);
+    if (ownWorkspace.size() < needed) {
+        ownWorkspace.resize(needed);
+    }
+    Workspace ws;
+    layoutWorkspace(reinterpret_cast<uintptr_t>(ownWorkspace.data()), 1, &ws);
+    memcpy(ws.frequencies, histogram, DHC_ALPHABET_SIZE * sizeof(uint32_t));
+    buildHuffmanCodes(ws);
+    if (1 + 2 * ws.maxLength + ws.distinct > capacity) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return 0;
+    }
+    memcpy(codes, ws.codes, DHC_ALPHABET_SIZE * sizeof(HuffmanCode));
+    size_t tableSize = writeCodeTable(ws, output);
+#if DHC_STATS
+    stats.tableBytes += tableSize;
+    DHC_STATS_MAX(stats.longestCode, ws.maxLength);
+#endif
+    return tableSize;
+}
+
+size_t DHC::compressRecord(const uint8_t* input, size_t frames, uint8_t* output, size_t capacity) {
+    size_t blockSamples = std::min(frames, static_cast<size_t>(MAX_BLOCK_SAMPLES));
+    size_t needed = workspace_size(blockSamples);
+    if (ownWorkspace.size() < needed) {
+        ownWorkspace.resize(needed);
+    }
+    Workspace ws;
+    layoutWorkspace(reinterpret_cast<uintptr_t>(ownWorkspace.data()), blockSamples, &ws);
+    size_t size = compressFrames(input, frames, output, capacity, ws);
+#if DHC_STATS
+    noteHeap(0);
+#endif
+    return size;
+}
+
+bool DHC::decompress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
+    if (!input || !output || !output_size || input_size < 2 + BLOCK_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    return decodeContainer(input, input_size, output, output_size, nullptr, nullptr);
+}
+
+bool DHC::decompress(const uint8_t* input, size_t input_size, SampleSink sink, void* context) {
+    if (!input || !sink || input_size < 2 + BLOCK_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    size_t written = 0;
+    return decodeContainer(input, input_size, nullptr, &written, sink, context);
+}
+
+bool DHC::decodeContainer(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size,
+                          SampleSink sink, void* context) {
+
+    // Verify magic number, multi-channel data carries its channel count and
+    // other sample formats the format too
+    uint16_t magic = readU16(input);
+    unsigned channels = 1;
+    uint8_t format = SAMPLE_DEFAULT;
+    size_t pos = 2;
+    if (magic == CHANNELS_MAGIC || magic == FORMAT_MAGIC) {
+        channels = input[pos++];
+        if (channels == 0 || channels > MAX_CHANNELS) {
+            ESP_LOGE(TAG, "Invalid channel count: %u", channels);
+            return false;
+        }
+        if (magic == FORMAT_MAGIC) format = input[pos++];
+    } else if (magic == FILE_MAGIC) {
+        // A file held in memory: single-channel 16-bit blocks up to the seek
+        // index, which must hold the original size the header gives
+        ContainerInfo info;
+        if (!inspect(input, input_size, &info)) {
+            ESP_LOGE(TAG, "Invalid seek index");
+            return false;
+        }
+        resetTableReuse();
+        if (!decodeBlocks(input + info.blocksBegin, info.blocksEnd - info.blocksBegin, 1, SAMPLE_DEFAULT, output,
+                          output_size, sink, context)) {
+            return false;
+        }
+        if (*output_size / sizeof(uint16_t) != readU32(input + 2) / sizeof(uint16_t)) {
+            ESP_LOGE(TAG, "Corrupt compressed data");
+            return false;
+        }
+        return true;
+    } else if (magic != MAGIC) {
+        ESP_LOGE(TAG, "Invalid magic number");
+        return false;
+    }
+    resetTableReuse();
+    return decodeBlocks(input + pos, input_size - pos, channels, format, output, output_size, sink, context);
+}
+
+bool DHC::decodeBlocks(const uint8_t* input, size_t input_size, unsigned channels, uint8_t format, uint8_t* output,
+                       size_t* output_size, SampleSink sink, void* context) {
+    const unsigned planes = dhcSamplePlanes(format);
+    const DhcSampleCoder* coders[DHC_MAX_SAMPLE_PLANES] = {};
+    for (unsigned plane = 0; plane < planes; plane++) {
+        coders[plane] = dhcSampleCoder(format, plane);
+        if (!coders[plane]) {
+            ESP_LOGE(TAG, "Unsupported sample format: 0x%02X", format);
+            return false;
+        }
+    }
+    // The sink takes 16-bit values; the residuals of narrower samples are
+    // those of the samples sign- or zero-extended, so they decode as 16-bit
+    if (sink && planes > 1) {
+        ESP_LOGE(TAG, "%u-bit samples cannot be decoded to a sink", dhcSampleBits(format));
+        return false;
+    }
+    if (sink) {
+        coders[0] = dhcSampleCoder(SAMPLE_DEFAULT, 0);
+    }
+
+    size_t written = 0;  // samples
+    size_t pos = 0;
+    while (pos < input_size) {
+        // One block per lane, all of the same length; samples go straight to
+        // their interleaved place in the output, or in the span for the sink
+        size_t frameCount = 0;
+        uint8_t* frames = output;
+        size_t first = sink ? 0 : written;
+        for (unsigned lane = 0; lane < channels * planes; lane++) {
+            size_t length;
+            if (pos >= input_size || !blockLength(input + pos, input_size - pos, &length) ||
+                length > input_size - pos) {
+                ESP_LOGE(TAG, "Truncated or invalid block");
+                return false;
+            }
+            size_t count = readU32(input + pos);
+            if (lane == 0) {
+                frameCount = count;
+                if (sink) {
+                    decodedSamples.resize(frameCount * channels);
+                    frames = reinterpret_cast<uint8_t*>(decodedSamples.data());
+                } else if (dhcSampleCount(format, *output_size) / channels - written / channels < frameCount) {
+                    ESP_LOGE(TAG, "Output buffer too small");
+                    return false;
                 }
+            } else if (count != frameCount) {
+                ESP_LOGE(TAG, "Channel blocks differ in length");
+                return false;
+            }
+            if (!decodeBlock(input + pos, length, 0, lane, frames, channels, coders[lane % planes],
+                             first + lane / planes)) {
+                return false;
             }
+            pos += length;
         }
-        if (deltaValues.size() == originalSize) {
-            break;
+        if (sink && !sink(decodedSamples.data(), frameCount * channels, context)) {
+            ESP_LOGE(TAG, "Decoding stopped by the sink");
+            return false;
         }
+        written += frameCount * channels;
     }
 
-    // Reconstruct original values
-    std::vector<uint16_t> originalData = reconstructFromDelta(deltaValues);
-    
-    // Copy to output buffer
-    memcpy(output, originalData.data(), originalData.size() * sizeof(uint16_t));
-    *output_size = originalData.size() * sizeof(uint16_t);
-
+    if (sink) {
+        *output_size = written * sizeof(uint16_t);
+    } else {
+        dhcClearSamplePadding(format, output, written);
+        *output_size = dhcSampleBytes(format, written);
+    }
     return true;
 }
 
 bool DHC::compress_file(const char* input_file, const char* output_file) {
+    if (channelCount > 1) {
+        ESP_LOGE(TAG, "Files are single-channel");
+        return false;
+    }
+    if (sampleFormat != SAMPLE_DEFAULT) {
+        ESP_LOGE(TAG, "Files hold 16-bit little-endian samples");
+        return false;
+    }
+
     FILE* in_file = fopen(input_file, "rb");
     if (!in_file) {
         ESP_LOGE(TAG, "Failed to open input file: %s", input_file);
@@ -257,45 +1288,61 @@ bool DHC::compress_file(const char* input_file, const char* output_file) {
         return false;
     }
 
-    // Write magic number
-    uint8_t magic[2] = {static_cast<uint8_t>(MAGIC >> 8), static_cast<uint8_t>(MAGIC & 0xFF)};
-    fwrite(magic, 1, 2, out_file);
-
-    // Get file size
-    fseek(in_file, 0, SEEK_END);
-    uint32_t file_size = ftell(in_file);
-    fseek(in_file, 0, SEEK_SET);
-
-    // Write original file size
-    uint8_t size_bytes[4] = {
-        static_cast<uint8_t>((file_size >> 24) & 0xFF),
-        static_cast<uint8_t>((file_size >> 16) & 0xFF),
-        static_cast<uint8_t>((file_size >> 8) & 0xFF),
-        static_cast<uint8_t>(file_size & 0xFF)
-    };
-    fwrite(size_bytes, 1, 4, out_file);
-
-    // Allocate buffer for processing chunks
-    uint8_t* buffer = (uint8_t*)malloc(CHUNK_SIZE);
-    if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
-        fclose(in_file);
-        fclose(out_file);
-        return false;
-    }
-
-    bool success = true;
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, CHUNK_SIZE, in_file)) > 0) {
-        if (!process_file_chunk(in_file, out_file, buffer, bytes_read)) {
+    // Magic number, then the original file size, which is filled in at the end
+    bool success;
+    uint32_t file_size = 0;
+    {
+        DHCFileReader reader(in_file, fileBufferSize, fileBackgroundIo);
+        DHCFileWriter writer(out_file, fileBufferSize, fileBackgroundIo);
+        uint8_t header[FILE_HEADER_SIZE] = {};
+        writeU16(header, FILE_MAGIC);
+        success = writer.write(header, sizeof(header));
+        resetTableReuse();
+
+        // Every block is noted in the seek index as it is written
+        std::vector<uint8_t> chunk(CHUNK_SIZE);
+        std::vector<uint8_t> index;
+        uint32_t offset = FILE_HEADER_SIZE;
+        uint32_t tableOffset = 0;  // block whose table is kept for reuse, if any
+        size_t bytes_read;
+        while (success && (bytes_read = reader.read(chunk.data(), CHUNK_SIZE)) > 0) {
+            if (!process_file_chunk(writer, chunk.data(), bytes_read)) {
+                success = false;
+                break;
+            }
+            // Every block while a table is kept names it, so a range starting at
+            // a Rice or stored block can still decode the reuse blocks after it
+            uint8_t blockType = blockBuffer[8] & BLOCK_TYPE_MASK;
+            if (!tableReuse || !keptTables[0].valid) {
+                tableOffset = 0;
+            }
+            appendIndexEntry(index, IndexEntry{offset, file_size / 2, blockType == BLOCK_DYNAMIC ? 0 : tableOffset});
+            if (blockType == BLOCK_DYNAMIC) {
+                tableOffset = offset;
+            }
+            offset += blockBuffer.size();
+            file_size += bytes_read;
+        }
+        if (reader.failed()) {
+            ESP_LOGE(TAG, "Failed to read input file: %s", input_file);
             success = false;
-            break;
         }
+        success = success && writeFileIndex(writer, index, offset);
+        success = writer.finish() && success;
+        DHC_STATS_ADD(stats.ioTime, reader.io_time() + writer.io_time());
+#if DHC_STATS
+        noteHeap(reader.buffer_bytes() + writer.buffer_bytes() + chunk.capacity() + index.capacity());
+#endif
     }
 
-    free(buffer);
+    uint8_t size_bytes[4];
+    writeU32(size_bytes, file_size);
+    success = success && fseek(out_file, 2, SEEK_SET) == 0 && fwrite(size_bytes, 1, 4, out_file) == 4;
+
     fclose(in_file);
-    fclose(out_file);
+    if (fclose(out_file) != 0) {
+        success = false;
+    }
 
     if (!success) {
         remove(output_file);  // Delete the output file if compression failed
@@ -304,49 +1351,104 @@ bool DHC::compress_file(const char* input_file, const char* output_file) {
     return success;
 }
 
-bool DHC::process_file_chunk(FILE* in_file, FILE* out_file, uint8_t* buffer, size_t buffer_size) {
-    // Convert input to uint16_t vector
-    std::vector<uint16_t> data(buffer_size / 2);
-    memcpy(data.data(), buffer, buffer_size);
+bool DHC::process_file_chunk(DHCFileWriter& writer, const uint8_t* buffer, size_t buffer_size) {
+    blockBuffer.clear();
+    size_t samples = buffer_size / 2;
+    if (buffer_size % 2 != 0) {
+        // Only the last chunk can be short; its odd byte would be lost
+        ESP_LOGE(TAG, "File ends in half a sample");
+        return false;
+    }
+
+    // Encode the block, then hand it to the writer in one go
+    if (!appendBlock(buffer, samples, 1, 0, 0, blockBuffer) || !writer.write(blockBuffer.data(), blockBuffer.size())) {
+        ESP_LOGE(TAG, "Failed to write compressed block");
+        return false;
+    }
 
-    // Compute delta values
-    std::vector<int16_t> deltaValues = computeDeltaValues(data);
-    lastDeltaValues = deltaValues;
+    return true;
+}
 
-    // Build Huffman codes
-    auto huffmanCodes = buildHuffmanCodes(deltaValues);
-    lastHuffmanCodes = huffmanCodes;
+void DHC::appendIndexEntry(std::vector<uint8_t>& index, const IndexEntry& entry) {
+    size_t pos = index.size();
+    index.resize(pos + INDEX_ENTRY_SIZE);
+    writeU32(index.data() + pos, entry.offset);
+    writeU32(index.data() + pos + 4, entry.firstSample);
+    writeU32(index.data() + pos + 8, entry.tableOffset);
+}
 
-    // Write compressed data
-    std::vector<bool> bits;
-    for (const auto& value : deltaValues) {
-        const std::string& code = huffmanCodes[value];
-        for (char bit : code) {
-            bits.push_back(bit == '1');
-        }
+bool DHC::writeFileIndex(DHCFileWriter& writer, const std::vector<uint8_t>& index, uint32_t index_offset) {
+    // Index entries, then [block count][index offset][index magic]
+    uint8_t trailer[FILE_TRAILER_SIZE];
+    writeU32(trailer, static_cast<uint32_t>(index.size() / INDEX_ENTRY_SIZE));
+    writeU32(trailer + 4, index_offset);
+    writeU16(trailer + 8, INDEX_MAGIC);
+    if (!writer.write(index.data(), index.size()) || !writer.write(trailer, sizeof(trailer))) {
+        ESP_LOGE(TAG, "Failed to write seek index");
+        return false;
     }
+    return true;
+}
 
-    // Pack bits into bytes
-    uint8_t currentByte = 0;
-    int bitCount = 0;
+bool DHC::readFileIndex(FILE* in_file, std::vector<IndexEntry>& entries, uint32_t* index_offset) {
+    uint8_t trailer[FILE_TRAILER_SIZE];
+    if (fseek(in_file, 0, SEEK_END) != 0) return false;
+    long end = ftell(in_file);
+    if (end < static_cast<long>(FILE_HEADER_SIZE + FILE_TRAILER_SIZE) ||
+        fseek(in_file, end - FILE_TRAILER_SIZE, SEEK_SET) != 0 ||
+        fread(trailer, 1, sizeof(trailer), in_file) != sizeof(trailer) || readU16(trailer + 8) != INDEX_MAGIC) {
+        return false;
+    }
 
-    for (bool bit : bits) {
-        currentByte = (currentByte << 1) | (bit ? 1 : 0);
-        bitCount++;
-        
-        if (bitCount == 8) {
-            fwrite(&currentByte, 1, 1, out_file);
-            currentByte = 0;
-            bitCount = 0;
-        }
+    // The index fills the space between the blocks and the trailer
+    uint32_t count = readU32(trailer);
+    *index_offset = readU32(trailer + 4);
+    if (*index_offset < FILE_HEADER_SIZE ||
+        static_cast<uint64_t>(*index_offset) + static_cast<uint64_t>(count) * INDEX_ENTRY_SIZE + FILE_TRAILER_SIZE !=
+            static_cast<uint64_t>(end)) {
+        return false;
+    }
+    std::vector<uint8_t> index(count * INDEX_ENTRY_SIZE);
+    if (fseek(in_file, *index_offset, SEEK_SET) != 0 ||
+        fread(index.data(), 1, index.size(), in_file) != index.size()) {
+        return false;
     }
 
-    // Handle remaining bits
-    if (bitCount > 0) {
-        currentByte <<= (8 - bitCount);
-        fwrite(&currentByte, 1, 1, out_file);
+    // The blocks must hold the original size the header gives
+    uint8_t sizeBytes[4];
+    if (fseek(in_file, 2, SEEK_SET) != 0 || fread(sizeBytes, 1, sizeof(sizeBytes), in_file) != sizeof(sizeBytes)) {
+        return false;
+    }
+    const uint32_t samples = readU32(sizeBytes) / sizeof(uint16_t);
+    if ((count == 0) != (samples == 0)) {
+        return false;
     }
 
+    // Blocks follow each other from the header on, in sample order
+    entries.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        IndexEntry& entry = entries[i];
+        entry.offset = readU32(index.data() + i * INDEX_ENTRY_SIZE);
+        entry.firstSample = readU32(index.data() + i * INDEX_ENTRY_SIZE + 4);
+        entry.tableOffset = readU32(index.data() + i * INDEX_ENTRY_SIZE + 8);
+        uint32_t lastOffset = i > 0 ? entries[i - 1].offset : 0;
+        uint32_t lastSample = i > 0 ? entries[i - 1].firstSample : 0;
+        if ((i == 0 && (entry.offset != FILE_HEADER_SIZE || entry.firstSample != 0)) ||
+            (i > 0 && (entry.offset <= lastOffset || entry.firstSample <= lastSample)) ||
+            entry.offset >= *index_offset || entry.tableOffset >= entry.offset) {
+            return false;
+        }
+    }
+    if (count > 0) {
+        // The last block ends at the last sample
+        uint8_t lastSamples[4];
+        if (entries.back().offset + BLOCK_HEADER_SIZE > *index_offset ||
+            fseek(in_file, entries.back().offset, SEEK_SET) != 0 ||
+            fread(lastSamples, 1, sizeof(lastSamples), in_file) != sizeof(lastSamples) ||
+            static_cast<uint64_t>(entries.back().firstSample) + readU32(lastSamples) != samples) {
+            return false;
+        }
+    }
     return true;
 }
 
@@ -360,7 +1462,7 @@ bool DHC::decompress_file(const char* input_file, const char* output_file) {
     // Read and verify magic number
     uint8_t magic[2];
     if (fread(magic, 1, 2, in_file) != 2 ||
-        ((magic[0] << 8) | magic[1]) != MAGIC) {
+        readU16(magic) != FILE_MAGIC) {
         ESP_LOGE(TAG, "Invalid magic number");
         fclose(in_file);
         return false;
@@ -374,34 +1476,48 @@ bool DHC::decompress_file(const char* input_file, const char* output_file) {
         return false;
     }
 
-    FILE* out_file = fopen(output_file, "wb");
-    if (!out_file) {
-        ESP_LOGE(TAG, "Failed to open output file: %s", output_file);
+    // The seek index tells how many blocks there are
+    std::vector<IndexEntry> entries;
+    uint32_t index_offset;
+    DHC_STATS_BEGIN(lap);
+    bool indexRead = readFileIndex(in_file, entries, &index_offset);
+    DHC_STATS_LAP(lap, stats.ioTime);
+    if (!indexRead || fseek(in_file, FILE_HEADER_SIZE, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Invalid seek index");
         fclose(in_file);
         return false;
     }
 
-    // Allocate buffer for processing chunks
-    uint8_t* buffer = (uint8_t*)malloc(CHUNK_SIZE);
-    if (!buffer) {
-        ESP_LOGE(TAG, "Failed to allocate buffer");
+    FILE* out_file = fopen(output_file, "wb");
+    if (!out_file) {
+        ESP_LOGE(TAG, "Failed to open output file: %s", output_file);
         fclose(in_file);
-        fclose(out_file);
         return false;
     }
 
+    // Decode one block at a time, front to back
+    resetTableReuse();
     bool success = true;
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, CHUNK_SIZE, in_file)) > 0) {
-        if (!process_compressed_chunk(in_file, out_file, buffer, bytes_read)) {
-            success = false;
-            break;
+    {
+        DHCFileReader reader(in_file, fileBufferSize, fileBackgroundIo);
+        DHCFileWriter writer(out_file, fileBufferSize, fileBackgroundIo);
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (!process_compressed_chunk(reader, writer)) {
+                success = false;
+                break;
+            }
         }
+        success = writer.finish() && success;
+        DHC_STATS_ADD(stats.ioTime, reader.io_time() + writer.io_time());
+#if DHC_STATS
+        noteHeap(reader.buffer_bytes() + writer.buffer_bytes() + entries.capacity() * sizeof(IndexEntry));
+#endif
     }
 
-    free(buffer);
     fclose(in_file);
-    fclose(out_file);
+    if (fclose(out_file) != 0) {
+        success = false;
+    }
 
     if (!success) {
         remove(output_file);  // Delete the output file if decompression failed
@@ -410,57 +1526,167 @@ bool DHC::decompress_file(const char* input_file, const char* output_file) {
     return success;
 }
 
-bool DHC::process_compressed_chunk(FILE* in_file, FILE* out_file, uint8_t* buffer, size_t buffer_size) {
-    std::vector<bool> bits;
-    for (size_t i = 0; i < buffer_size; i++) {
-        std::bitset<8> byte_bits(buffer[i]);
-        for (int j = 7; j >= 0; j--) {
-            bits.push_back(byte_bits[j]);
+bool DHC::readFileBlock(DHCFileReader& reader, size_t* length) {
+    // Read the header, the length counts and then the rest of the block
+    size_t available = 0;
+    *length = 0;
+    while (true) {
+        if (!blockLength(blockBuffer.data(), available, length)) {
+            ESP_LOGE(TAG, "Invalid block header");
+            return false;
+        }
+        if (*length <= available) return true;
+        blockBuffer.resize(*length);
+        if (reader.read(blockBuffer.data() + available, *length - available) != *length - available) {
+            ESP_LOGE(TAG, "Truncated block");
+            return false;
         }
+        available = *length;
     }
+}
 
-    // Reconstruct Huffman tree from codes
-    auto huffmanCodes = lastHuffmanCodes;
-    std::shared_ptr<HuffmanNode> root = std::make_shared<HuffmanNode>(0, 0);
-    for (const auto& pair : huffmanCodes) {
-        std::shared_ptr<HuffmanNode> current = root;
-        for (char bit : pair.second) {
-            if (bit == '0') {
-                if (!current->left) {
-                    current->left = std::make_shared<HuffmanNode>(0, 0);
-                }
-                current = current->left;
-            } else {
-                if (!current->right) {
-                    current->right = std::make_shared<HuffmanNode>(0, 0);
-                }
-                current = current->right;
-            }
-        }
-        current->value = pair.first;
+bool DHC::process_compressed_chunk(DHCFileReader& reader, DHCFileWriter& writer) {
+    size_t length;
+    if (!readFileBlock(reader, &length)) {
+        return false;
     }
 
-    // Decode bits
-    std::vector<int16_t> deltaValues;
-    std::shared_ptr<HuffmanNode> current = root;
-    for (bool bit : bits) {
-        if (bit) {
-            current = current->right;
-        } else {
-            current = current->left;
+    // Decode straight into the writer's buffer when the block fits
+    size_t bytes = readU32(blockBuffer.data()) * sizeof(uint16_t);
+    uint8_t* output = writer.reserve(bytes);
+    bool written;
+    if (output) {
+        if (!decodeBlock(blockBuffer.data(), length, 0, 0, output, 1)) {
+            return false;
         }
-
-        if (!current->left && !current->right) {
-            deltaValues.push_back(current->value);
-            current = root;
+        written = writer.commit(bytes);
+    } else {
+        if (!decodeBlock(blockBuffer.data(), length, 0, 0, decodedSamples)) {
+            return false;
         }
+        written = writer.write(reinterpret_cast<const uint8_t*>(decodedSamples.data()), bytes);
+    }
+    if (!written) {
+        ESP_LOGE(TAG, "Failed to write decompressed samples");
+        return false;
     }
 
-    // Reconstruct original values
-    std::vector<uint16_t> originalData = reconstructFromDelta(deltaValues);
+    return true;
+}
 
-    // Write to output file
-    fwrite(originalData.data(), sizeof(uint16_t), originalData.size(), out_file);
+bool DHC::decompress_range(const char* input_file, size_t first_sample, size_t sample_count, uint8_t* output,
+                           size_t* output_size) {
+    if (!input_file || !output || !output_size) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    if (*output_size / sizeof(uint16_t) < sample_count) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return false;
+    }
 
-    return true;
-} 
\ No newline at end of file
+    FILE* in_file = fopen(input_file, "rb");
+    if (!in_file) {
+        ESP_LOGE(TAG, "Failed to open input file: %s", input_file);
+        return false;
+    }
+    uint8_t header[FILE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), in_file) != sizeof(header) || readU16(header) != FILE_MAGIC) {
+        ESP_LOGE(TAG, "Invalid magic number");
+        fclose(in_file);
+        return false;
+    }
+    std::vector<IndexEntry> entries;
+    uint32_t index_offset;
+    DHC_STATS_BEGIN(lap);
+    bool indexRead = readFileIndex(in_file, entries, &index_offset);
+    DHC_STATS_LAP(lap, stats.ioTime);
+    if (!indexRead) {
+        ESP_LOGE(TAG, "Invalid seek index");
+        fclose(in_file);
+        return false;
+    }
+    size_t samples = readU32(header + 2) / sizeof(uint16_t);
+    if (first_sample > samples || sample_count > samples - first_sample) {
+        ESP_LOGE(TAG, "Range beyond the end of the file");
+        fclose(in_file);
+        return false;
+    }
+    if (sample_count == 0) {
+        *output_size = 0;
+        fclose(in_file);
+        return true;
+    }
+
+    // Last block that starts at or before the range; unless it has a table of
+    // its own, the table kept for reuse at that point is loaded first
+    size_t block = std::upper_bound(entries.begin(), entries.end(), first_sample,
+                                    [](size_t sample, const IndexEntry& entry) { return sample < entry.firstSample; }) -
+                   entries.begin() - 1;
+    resetTableReuse();
+    bool success = true;
+    size_t length;
+    if (entries[block].tableOffset != 0) {
+        success = fseek(in_file, entries[block].tableOffset, SEEK_SET) == 0;
+        size_t tableBytes = entries[block].offset - entries[block].tableOffset;
+        DHCFileReader reader(in_file, std::min(fileBufferSize, tableBytes));
+        success = success && readFileBlock(reader, &length) && loadBlockTable(blockBuffer.data(), length, 0);
+        DHC_STATS_ADD(stats.ioTime, reader.io_time());
+    }
+
+    // Decode blocks until the range is covered, keeping the part inside it.
+    // Reads stop where the blocks of the range end.
+    const size_t end = first_sample + sample_count;
+    size_t last = std::lower_bound(entries.begin() + block, entries.end(), end,
+                                   [](const IndexEntry& entry, size_t sample) { return entry.firstSample < sample; }) -
+                  entries.begin();
+    uint32_t spanEnd = last < entries.size() ? entries[last].offset : index_offset;
+    success = success && fseek(in_file, entries[block].offset, SEEK_SET) == 0;
+    size_t written = 0;
+    if (success) {
+        DHCFileReader reader(in_file, std::min<size_t>(fileBufferSize, spanEnd - entries[block].offset),
+                             fileBackgroundIo);
+        for (; block < last; block++) {
+            if (!readFileBlock(reader, &length)) {
+                success = false;
+                break;
+            }
+            // Part of the block inside the range, which must continue where the
+            // last block left off
+            size_t blockFirst = entries[block].firstSample;
+            size_t count = readU32(blockBuffer.data());
+            size_t from = std::max(first_sample, blockFirst) - blockFirst;
+            size_t to = std::min(end, blockFirst + count) - blockFirst;
+            if (to <= from || blockFirst + from - first_sample != written) {
+                ESP_LOGE(TAG, "Corrupt compressed data");
+                success = false;
+                break;
+            }
+
+            // Blocks inside the range are decoded in place, the ends through scratch
+            uint8_t* target = output + written * sizeof(uint16_t);
+            if (from == 0 && to == count) {
+                success = decodeBlock(blockBuffer.data(), length, 0, 0, target, 1);
+            } else {
+                success = decodeBlock(blockBuffer.data(), length, 0, 0, decodedSamples);
+                if (success) {
+                    memcpy(target, decodedSamples.data() + from, (to - from) * sizeof(uint16_t));
+                }
+            }
+            if (!success) break;
+            written += to - from;
+        }
+        DHC_STATS_ADD(stats.ioTime, reader.io_time());
+#if DHC_STATS
+        noteHeap(reader.buffer_bytes() + entries.capacity() * sizeof(IndexEntry));
+#endif
+    }
+    fclose(in_file);
+
+    if (success && written != sample_count) {
+        ESP_LOGE(TAG, "Corrupt compressed data");
+        success = false;
+    }
+    *output_size = success ? written * sizeof(uint16_t) : 0;
+    return success;
+}
@@ -0,0 +1,253 @@
+#include "dhc_base64.h"
+#include <string.h>
+#include "esp_log.h"
+#include <algorithm>
+
+#define TAG "DHC_BASE64"
+
+// Decoded bytes are handed to the encoder in batches of up to this many
+static const size_t DECODE_BATCH = 192;
+
+static const char ENCODE_TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Sextet of every input character, or one of the markers above 63
+static const uint8_t CHAR_INVALID = 0xFF;
+static const uint8_t CHAR_SKIP = 0xFE;
+static const uint8_t CHAR_PAD = 0xFD;
+
+struct DecodeTable {
+    uint8_t value[256];
+    constexpr DecodeTable() : value() {
+        for (unsigned c = 0; c < 256; c++) {
+            value[c] = CHAR_INVALID;
+        }
+        for (unsigned i = 0; i < 64; i++) {
+            value[static_cast<uint8_t>(ENCODE_TABLE[i])] = static_cast<uint8_t>(i);
+        }
+        value[static_cast<uint8_t>('=')] = CHAR_PAD;
+        value[static_cast<uint8_t>(' ')] = CHAR_SKIP;
+        value[static_cast<uint8_t>('\t')] = CHAR_SKIP;
+        value[static_cast<uint8_t>('\r')] = CHAR_SKIP;
+        value[static_cast<uint8_t>('\n')] = CHAR_SKIP;
+    }
+};
+static constexpr DecodeTable DECODE_TABLE;
+
+bool dhcBase64Decode(const char* text, size_t length, std::vector<uint8_t>& output) {
+    if (!text && length > 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    output.clear();
+    output.reserve(length / 4 * 3);
+    uint32_t bits = 0;
+    unsigned sextets = 0;
+    bool ended = false;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t value = DECODE_TABLE.value[static_cast<uint8_t>(text[i])];
+        if (value < 64) {
+            if (ended) {
+                ESP_LOGE(TAG, "Data after base64 padding");
+                return false;
+            }
+            bits = (bits << 6) | value;
+            if (++sextets == 4) {
+                output.push_back(static_cast<uint8_t>(bits >> 16));
+                output.push_back(static_cast<uint8_t>(bits >> 8));
+                output.push_back(static_cast<uint8_t>(bits));
+                bits = 0;
+                sextets = 0;
+            }
+        } else if (value == CHAR_PAD) {
+            ended = true;
+        } else if (value == CHAR_INVALID) {
+            ESP_LOGE(TAG, "Invalid base64 character 0x%02x", static_cast<uint8_t>(text[i]));
+            return false;
+        }
+    }
+    // 2 sextets hold one byte, 3 hold two
+    if (sextets == 1) {
+        ESP_LOGE(TAG, "Truncated base64 input");
+        return false;
+    }
+    if (sextets == 2) {
+        output.push_back(static_cast<uint8_t>(bits >> 4));
+    } else if (sextets == 3) {
+        output.push_back(static_cast<uint8_t>(bits >> 10));
+        output.push_back(static_cast<uint8_t>(bits >> 2));
+    }
+    return true;
+}
+
+DHCBase64Pipeline::DHCBase64Pipeline(OutputCallback output, void* context, size_t block_samples)
+    : streamEncoder(block_samples), output(output), context(context) {}
+
+bool DHCBase64Pipeline::push(const char* input, size_t length) {
+    if (!input && length > 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+
+    uint8_t decoded[DECODE_BATCH];
+    size_t count = 0;
+    size_t i = 0;
+    while (i < length) {
+        if (count + 3 > DECODE_BATCH) {
+            if (!feed(decoded, count)) return false;
+            count = 0;
+        }
+
+        // Whole quads on quad boundaries, the common case
+        if (inSextets == 0 && !inputEnded) {
+            size_t end = i + std::min((length - i) / 4, (DECODE_BATCH - count) / 3) * 4;
+            for (; i < end; i += 4) {
+                uint32_t a = DECODE_TABLE.value[static_cast<uint8_t>(input[i])];
+                uint32_t b = DECODE_TABLE.value[static_cast<uint8_t>(input[i + 1])];
+                uint32_t c = DECODE_TABLE.value[static_cast<uint8_t>(input[i + 2])];
+                uint32_t d = DECODE_TABLE.value[static_cast<uint8_t>(input[i + 3])];
+                if ((a | b | c | d) > 63) break;
+                uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+                decoded[count++] = static_cast<uint8_t>(bits >> 16);
+                decoded[count++] = static_cast<uint8_t>(bits >> 8);
+                decoded[count++] = static_cast<uint8_t>(bits);
+            }
+            if (i == length || count + 3 > DECODE_BATCH) continue;
+        }
+
+        // One character at a time around whitespace, padding and fragment ends
+        uint8_t value = DECODE_TABLE.value[static_cast<uint8_t>(input[i++])];
+        if (value < 64) {
+            if (inputEnded) {
+                ESP_LOGE(TAG, "Data after base64 padding");
+                return false;
+            }
+            inBits = (inBits << 6) | value;
+            if (++inSextets == 4) {
+                decoded[count++] = static_cast<uint8_t>(inBits >> 16);
+                decoded[count++] = static_cast<uint8_t>(inBits >> 8);
+                decoded[count++] = static_cast<uint8_t>(inBits);
+                inBits = 0;
+                inSextets = 0;
+            }
+        } else if (value == CHAR_PAD) {
+            if (!inputEnded && !decodeTail(decoded, &count)) return false;
+            inputEnded = true;
+        } else if (value == CHAR_INVALID) {
+            ESP_LOGE(TAG, "Invalid base64 character 0x%02x", static_cast<uint8_t>(input[i - 1]));
+            return false;
+        }
+    }
+    return feed(decoded, count);
+}
+
+bool DHCBase64Pipeline::decodeTail(uint8_t* out, size_t* count) {
+    // 2 sextets hold one byte, 3 hold two
+    switch (inSextets) {
+    case 0:
+        break;
+    case 1:
+        ESP_LOGE(TAG, "Truncated base64 input");
+        return false;
+    case 2:
+        out[(*count)++] = static_cast<uint8_t>(inBits >> 4);
+        break;
+    default:
+        out[(*count)++] = static_cast<uint8_t>(inBits >> 10);
+        out[(*count)++] = static_cast<uint8_t>(inBits >> 2);
+        break;
+    }
+    inBits = 0;
+    inSextets = 0;
+    return true;
+}
+
+bool DHCBase64Pipeline::feed(const uint8_t* data, size_t size) {
+    if (size == 0) return true;
+    bytesIn += size;
+    if (!streamEncoder.push_bytes(data, size)) {
+        return false;
+    }
+    drainEncoder();
+    return true;
+}
+
+void DHCBase64Pipeline::drainEncoder() {
+    uint8_t chunk[DECODE_BATCH];
+    size_t count;
+    while ((count = streamEncoder.pull(chunk, sizeof(chunk))) > 0) {
+        bytesOut += count;
+        encodeOutput(chunk, count);
+    }
+}
+
+void DHCBase64Pipeline::encodeOutput(const uint8_t* data, size_t size) {
+    // Complete a triple left over from the last call first
+    while (carried > 0 && carried < 3 && size > 0) {
+        carry[carried++] = *data++;
+        size--;
+    }
+    if (carried == 3) {
+        putTriple(carry, 3);
+        carried = 0;
+    }
+    for (; size >= 3; data += 3, size -= 3) {
+        putTriple(data, 3);
+    }
+    while (size > 0) {
+        carry[carried++] = *data++;
+        size--;
+    }
+}
+
+void DHCBase64Pipeline::putTriple(const uint8_t* data, size_t count) {
+    if (textLength + 4 > OUTPUT_CHUNK) {
+        emitText();
+    }
+    uint32_t bits = static_cast<uint32_t>(data[0]) << 16;
+    if (count > 1) bits |= data[1] << 8;
+    if (count > 2) bits |= data[2];
+    char* out = text + textLength;
+    out[0] = ENCODE_TABLE[bits >> 18];
+    out[1] = ENCODE_TABLE[(bits >> 12) & 0x3F];
+    out[2] = count > 1 ? ENCODE_TABLE[(bits >> 6) & 0x3F] : '=';
+    out[3] = count > 2 ? ENCODE_TABLE[bits & 0x3F] : '=';
+    textLength += 4;
+}
+
+void DHCBase64Pipeline::emitText() {
+    if (textLength > 0 && output) {
+        output(text, textLength, context);
+    }
+    textLength = 0;
+}
+
+bool DHCBase64Pipeline::flush(bool end_of_input) {
+    if (end_of_input && !inputEnded) {
+        // Input without padding
+        uint8_t tail[2];
+        size_t count = 0;
+        if (!decodeTail(tail, &count) || !feed(tail, count)) return false;
+        inputEnded = true;
+    }
+    if (!streamEncoder.flush(end_of_input)) {
+        return false;
+    }
+    drainEncoder();
+    if (end_of_input && carried > 0) {
+        putTriple(carry, carried);
+        carried = 0;
+    }
+    emitText();
+    return true;
+}
+
+void DHCBase64Pipeline::reset() {
+    streamEncoder.reset();
+    inBits = 0;
+    inSextets = 0;
+    inputEnded = false;
+    bytesIn = 0;
+    carried = 0;
+    textLength = 0;
+    bytesOut = 0;
+}
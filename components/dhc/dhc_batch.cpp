@@ -0,0 +1,308 @@
+#include "dhc_batch.h"
+#include <string.h>
+#include "esp_log.h"
+#include "dhc_predictor.h"
+#include <algorithm>
+
+#define TAG "DHC_BATCH"
+
+// Magic, channel count, sample format and record count
+static const size_t BATCH_HEADER_SIZE = 8;
+static const size_t MAX_LENGTH_BYTES = 5;  // of a 32-bit record length
+
+static inline void writeU32(uint8_t* out, uint32_t value) {
+    out[0] = static_cast<uint8_t>((value >> 24) & 0xFF);
+    out[1] = static_cast<uint8_t>((value >> 16) & 0xFF);
+    out[2] = static_cast<uint8_t>((value >> 8) & 0xFF);
+    out[3] = static_cast<uint8_t>(value & 0xFF);
+}
+
+static inline uint32_t readU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+// Record lengths: 7 bits per byte, low bits first; returns the bytes written
+static size_t writeLength(uint8_t* out, uint32_t value) {
+    size_t pos = 0;
+    while (value >= 0x80) {
+        out[pos++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    out[pos++] = static_cast<uint8_t>(value);
+    return pos;
+}
+
+// Returns the bytes read, 0 if the length is truncated or too long
+static size_t readLength(const uint8_t* in, size_t available, uint32_t* value) {
+    uint64_t result = 0;
+    for (size_t pos = 0; pos < available && pos < MAX_LENGTH_BYTES; pos++) {
+        result |= static_cast<uint64_t>(in[pos] & 0x7F) << (7 * pos);
+        if (!(in[pos] & 0x80)) {
+            if (result > UINT32_MAX) return 0;
+            *value = static_cast<uint32_t>(result);
+            return pos + 1;
+        }
+    }
+    return 0;
+}
+
+size_t DHCBatchEncoder::recordFrames(const DHCRecord& record) const {
+    return dhcSampleCount(codec.sample_format(), record.size) / codec.channels();
+}
+
+size_t DHCBatchEncoder::compress_bound(const DHCRecord* records, size_t count) const {
+    // Largest shared table: every symbol, codes of up to the length limit
+    size_t bound = BATCH_HEADER_SIZE + 1 + 2 * DHC::CODE_LENGTH_LIMIT + DHC_ALPHABET_SIZE + 4;
+    for (size_t i = 0; i < count; i++) {
+        size_t blocks = DHC::blocksBound(recordFrames(records[i]), codec.lanes(), DHC::MAX_BLOCK_SAMPLES);
+        bound += blocks + MAX_LENGTH_BYTES;
+    }
+    return bound;
+}
+
+size_t DHCBatchEncoder::writeSharedTable(const DHCRecord* records, size_t count, uint8_t* output,
+                                         size_t capacity) {
+    // Static tables and Rice coding need no table; neither do empty batches
+    if (codec.static_table() == 0 && codec.engine() != DHC::ENGINE_RICE) {
+        uint32_t histogram[DHC_ALPHABET_SIZE] = {};
+        bool any = false;
+        for (size_t i = 0; i < count; i++) {
+            size_t frames = recordFrames(records[i]);
+            codec.addRecordHistogram(records[i].data, frames, histogram);
+            any = any || frames > 0;
+        }
+        if (any) {
+            return codec.writeSharedTable(histogram, sharedCodes, output, capacity);
+        }
+    }
+    if (capacity < 1) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return 0;
+    }
+    output[0] = 0;
+    return 1;
+}
+
+bool DHCBatchEncoder::compress(const DHCRecord* records, size_t count, uint8_t* output, size_t* output_size) {
+    if ((!records && count > 0) || !output || !output_size || count > UINT32_MAX) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    const unsigned channels = codec.channels();
+    const uint8_t format = codec.sample_format();
+    for (size_t i = 0; i < count; i++) {
+        size_t frames = recordFrames(records[i]);
+        if ((records[i].size > 0 && !records[i].data) || dhcSampleBytes(format, frames * channels) != records[i].size) {
+            ESP_LOGE(TAG, "Record %u is not a whole number of %u-channel frames of %u-bit samples", (unsigned)i,
+                     channels, dhcSampleBits(format));
+            return false;
+        }
+        if (records[i].size > 0 && !dhcSamplePaddingClear(format, records[i].data, frames * channels)) {
+            ESP_LOGE(TAG, "Unused half of the last byte of record %u is not zero", (unsigned)i);
+            return false;
+        }
+    }
+    if (*output_size < BATCH_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return false;
+    }
+    output[0] = static_cast<uint8_t>(BATCH_MAGIC >> 8);
+    output[1] = static_cast<uint8_t>(BATCH_MAGIC & 0xFF);
+    output[2] = static_cast<uint8_t>(channels);
+    output[3] = format;
+    writeU32(output + 4, static_cast<uint32_t>(count));
+    size_t pos = BATCH_HEADER_SIZE;
+
+    size_t tableSize = writeSharedTable(records, count, output + pos, *output_size - pos);
+    if (tableSize == 0) {
+        return false;
+    }
+    pos += tableSize;
+    uint8_t* recordBytes = output + pos;
+    pos += 4;
+    if (*output_size < pos) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return false;
+    }
+
+    // Every record is coded like a buffer of its own, blocks coded with
+    // Huffman codes taking the shared ones
+    const size_t start = pos;
+    recordLengths.clear();
+    codec.sharedCodes = tableSize > 1 ? sharedCodes : nullptr;
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; i++) {
+        size_t frames = recordFrames(records[i]);
+        size_t size = 0;
+        if (frames > 0) {
+            size = codec.compressRecord(records[i].data, frames, output + pos, *output_size - pos);
+            ok = size > 0;
+        }
+        pos += size;
+        recordLengths.push_back(static_cast<uint32_t>(size));
+        if (ok && pos - start > UINT32_MAX) {
+            ESP_LOGE(TAG, "Batch too large");
+            ok = false;
+        }
+    }
+    codec.sharedCodes = nullptr;
+    if (!ok) {
+        return false;
+    }
+    writeU32(recordBytes, static_cast<uint32_t>(pos - start));
+
+    for (uint32_t length : recordLengths) {
+        uint8_t bytes[MAX_LENGTH_BYTES];
+        size_t used = writeLength(bytes, length);
+        if (*output_size - pos < used) {
+            ESP_LOGE(TAG, "Output buffer too small");
+            return false;
+        }
+        memcpy(output + pos, bytes, used);
+        pos += used;
+    }
+    *output_size = pos;
+    return true;
+}
+
+bool DHCBatchDecoder::open(const uint8_t* batch, size_t batch_size) {
+    recordEnds.clear();
+    if (!batch || batch_size < BATCH_HEADER_SIZE + 1) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    if (((batch[0] << 8) | batch[1]) != DHCBatchEncoder::BATCH_MAGIC) {
+        ESP_LOGE(TAG, "Invalid magic number");
+        return false;
+    }
+    unsigned batchChannels = batch[2];
+    uint8_t format = batch[3];
+    if (batchChannels == 0 || batchChannels > DHC::MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Invalid channel count: %u", batchChannels);
+        return false;
+    }
+    const unsigned planes = dhcSamplePlanes(format);
+    for (unsigned plane = 0; plane < planes; plane++) {
+        if (!dhcSampleCoder(format, plane)) {
+            ESP_LOGE(TAG, "Unsupported sample format: 0x%02X", format);
+            return false;
+        }
+    }
+    size_t count = readU32(batch + 4);
+    size_t pos = BATCH_HEADER_SIZE;
+
+    // The shared table becomes the previous table of every lane, so the
+    // reuse blocks of any record decode with it, and stays so
+    codec.keepSharedTable = true;
+    if (batch[pos] == 0) {
+        codec.resetTableReuse();
+        pos++;
+    } else {
+        size_t tableSize = codec.loadSharedTable(batch + pos, batch_size - pos, batchChannels * planes);
+        if (tableSize == 0) {
+            return false;
+        }
+        pos += tableSize;
+    }
+    if (batch_size - pos < 4 || readU32(batch + pos) > batch_size - pos - 4) {
+        ESP_LOGE(TAG, "Truncated batch");
+        return false;
+    }
+    const size_t bytes = readU32(batch + pos);
+    const uint8_t* first = batch + pos + 4;
+    const uint8_t* lengths = first + bytes;
+    const size_t lengthBytes = batch_size - pos - 4 - bytes;
+
+    // Records are checked once here: their lengths add up to the record bytes,
+    // and they are whole blocks
+    recordEnds.reserve(std::min(count, lengthBytes));
+    size_t begin = 0;
+    size_t used = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t length;
+        size_t read = readLength(lengths + used, lengthBytes - used, &length);
+        if (read == 0 || length > bytes - begin) {
+            ESP_LOGE(TAG, "Invalid length of record %u", (unsigned)i);
+            recordEnds.clear();
+            return false;
+        }
+        used += read;
+        const size_t end = begin + length;
+        while (begin < end) {
+            size_t blockSize;
+            if (!codec.blockLength(first + begin, end - begin, &blockSize) || blockSize > end - begin) {
+                ESP_LOGE(TAG, "Invalid block in record %u", (unsigned)i);
+                recordEnds.clear();
+                return false;
+            }
+            begin += blockSize;
+        }
+        recordEnds.push_back(static_cast<uint32_t>(end));
+    }
+    if (begin != bytes || used != lengthBytes) {
+        ESP_LOGE(TAG, "Trailing bytes in the batch");
+        recordEnds.clear();
+        return false;
+    }
+
+    records = first;
+    channels = batchChannels;
+    sampleFormat = format;
+    return true;
+}
+
+bool DHCBatchDecoder::findRecord(size_t index, const uint8_t** record, size_t* size) const {
+    if (index >= recordEnds.size()) {
+        ESP_LOGE(TAG, "No record %u in the batch", (unsigned)index);
+        return false;
+    }
+    size_t begin = index > 0 ? recordEnds[index - 1] : 0;
+    *record = records + begin;
+    *size = recordEnds[index] - begin;
+    return true;
+}
+
+size_t DHCBatchDecoder::record_size(size_t index) const {
+    const uint8_t* record;
+    size_t size;
+    if (!findRecord(index, &record, &size)) {
+        return 0;
+    }
+    // Blocks were checked by open(); every plane of a sample has a block
+    size_t samples = 0;
+    for (size_t pos = 0; pos < size;) {
+        size_t length;
+        codec.blockLength(record + pos, size - pos, &length);
+        samples += readU32(record + pos);
+        pos += length;
+    }
+    return dhcSampleBytes(sampleFormat, samples / dhcSamplePlanes(sampleFormat));
+}
+
+bool DHCBatchDecoder::decodeRecord(size_t index, uint8_t* output, size_t* output_size, DHC::SampleSink sink,
+                                   void* context) {
+    const uint8_t* record;
+    size_t size;
+    if (!findRecord(index, &record, &size)) {
+        return false;
+    }
+    return codec.decodeBlocks(record, size, channels, sampleFormat, output, output_size, sink, context);
+}
+
+bool DHCBatchDecoder::decompress(size_t index, uint8_t* output, size_t* output_size) {
+    if (!output || !output_size) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    return decodeRecord(index, output, output_size, nullptr, nullptr);
+}
+
+bool DHCBatchDecoder::decompress(size_t index, DHC::SampleSink sink, void* context) {
+    if (!sink) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    size_t written = 0;
+    return decodeRecord(index, nullptr, &written, sink, context);
+}
@@ -0,0 +1,226 @@
+#include "dhc_file_io.h"
+#include <string.h>
+#include "esp_log.h"
+#include <algorithm>
+
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#endif
+
+#define TAG "DHC_FILE"
+
+#if defined(ESP_PLATFORM)
+static const uint32_t IO_TASK_STACK_SIZE = 3072;
+#endif
+
+DHCFileBuffer::DHCFileBuffer(FILE* file, size_t buffer_size, bool background, bool writing)
+    : file(file), bufferSize(std::max<size_t>(buffer_size, 1)), buffers(background ? 2 : 1), writing(writing),
+      background(background) {
+    for (std::vector<uint8_t>& buffer : buffers) {
+        buffer.resize(bufferSize);
+    }
+    if (!background) return;
+
+    running = true;
+#if defined(ESP_PLATFORM)
+    // Same priority as the caller, on whichever core is free: the task mostly
+    // waits for the flash driver
+    if (xTaskCreatePinnedToCore(taskEntry, "dhc_io", IO_TASK_STACK_SIZE, this, uxTaskPriorityGet(nullptr), nullptr,
+                                tskNO_AFFINITY) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start I/O task, using blocking I/O");
+        running = false;
+        this->background = false;
+    }
+#else
+    thread = std::thread(taskEntry, this);
+#endif
+}
+
+DHCFileBuffer::~DHCFileBuffer() {
+    if (pending) {
+        finishIo();
+    }
+    if (!background) return;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return !running; });
+    }
+#if !defined(ESP_PLATFORM)
+    thread.join();
+#endif
+}
+
+size_t DHCFileBuffer::transfer(unsigned index, size_t size, bool* ok) {
+    uint8_t* data = buffers[index].data();
+    size_t done = writing ? fwrite(data, 1, size, file) : fread(data, 1, size, file);
+    *ok = writing ? done == size : ferror(file) == 0;
+    return done;
+}
+
+void DHCFileBuffer::startIo(unsigned index, size_t size) {
+    pending = true;
+    if (!background) {
+        DHC_STATS_BEGIN(lap);
+        ioResult = transfer(index, size, &ioOk);
+        DHC_STATS_LAP(lap, ioTime);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ioIndex = index;
+        ioSize = size;
+        state = IO_QUEUED;
+    }
+    changed.notify_all();
+}
+
+size_t DHCFileBuffer::finishIo() {
+    pending = false;
+    if (background) {
+        DHC_STATS_BEGIN(lap);
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return state == IO_DONE; });
+        state = IO_IDLE;
+        DHC_STATS_LAP(lap, ioTime);
+    }
+    if (!ioOk) {
+        ioFailed = true;
+    }
+    return ioResult;
+}
+
+void DHCFileBuffer::taskEntry(void* context) {
+    static_cast<DHCFileBuffer*>(context)->taskLoop();
+#if defined(ESP_PLATFORM)
+    vTaskDelete(nullptr);
+#endif
+}
+
+void DHCFileBuffer::taskLoop() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        changed.wait(guard, [this] { return stopping || state == IO_QUEUED; });
+        if (state != IO_QUEUED) break;
+
+        unsigned index = ioIndex;
+        size_t size = ioSize;
+        guard.unlock();
+        bool ok;
+        size_t done = transfer(index, size, &ok);
+        guard.lock();
+        ioResult = done;
+        ioOk = ok;
+        state = IO_DONE;
+        changed.notify_all();
+    }
+    running = false;
+    changed.notify_all();
+}
+
+DHCFileReader::DHCFileReader(FILE* file, size_t buffer_size, bool background)
+    : DHCFileBuffer(file, buffer_size, background, false) {
+    // Read ahead from the start
+    startIo(ahead, bufferSize);
+}
+
+size_t DHCFileReader::read(uint8_t* data, size_t size) {
+    size_t copied = 0;
+    while (copied < size) {
+        if (position == available && !refill()) break;
+        size_t count = std::min(size - copied, available - position);
+        memcpy(data + copied, buffers[current].data() + position, count);
+        position += count;
+        copied += count;
+    }
+    return copied;
+}
+
+bool DHCFileReader::refill() {
+    if (atEnd) return false;
+    if (!ioPending()) {
+        ahead = current;
+        startIo(ahead, bufferSize);
+    }
+
+    // The buffer read ahead becomes the current one, and the one just
+    // consumed is read into next
+    current = ahead;
+    available = finishIo();
+    position = 0;
+    if (available < bufferSize || failed()) {
+        atEnd = true;
+    } else if (bufferCount() > 1) {
+        ahead = 1 - current;
+        startIo(ahead, bufferSize);
+    }
+    return available > 0;
+}
+
+DHCFileWriter::DHCFileWriter(FILE* file, size_t buffer_size, bool background)
+    : DHCFileBuffer(file, buffer_size, background, true) {}
+
+bool DHCFileWriter::write(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        size_t count = std::min(size, bufferSize - used);
+        memcpy(buffers[current].data() + used, data, count);
+        used += count;
+        data += count;
+        size -= count;
+        if (used == bufferSize) {
+            flushCurrent();
+        }
+    }
+    return !failed();
+}
+
+uint8_t* DHCFileWriter::reserve(size_t size) {
+    if (size > bufferSize) return nullptr;
+    if (size > bufferSize - used) {
+        flushCurrent();
+    }
+    return buffers[current].data() + used;
+}
+
+bool DHCFileWriter::commit(size_t size) {
+    used += size;
+    if (used == bufferSize) {
+        flushCurrent();
+    }
+    return !failed();
+}
+
+void DHCFileWriter::flushCurrent() {
+    // One write in flight at a time; with two buffers the caller fills the
+    // other one meanwhile
+    if (ioPending()) {
+        finishIo();
+    }
+    startIo(current, used);
+    current = (current + 1) % bufferCount();
+    used = 0;
+}
+
+bool DHCFileWriter::finish() {
+    if (used > 0) {
+        flushCurrent();
+    }
+    if (ioPending()) {
+        finishIo();
+    }
+    DHC_STATS_BEGIN(lap);
+    if (fflush(file) != 0) {
+        ioFailed = true;
+    }
+    DHC_STATS_LAP(lap, ioTime);
+    if (failed()) {
+        ESP_LOGE(TAG, "Failed to write file");
+    }
+    return !failed();
+}
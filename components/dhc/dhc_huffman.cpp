@@ -0,0 +1,190 @@
+#include "dhc_huffman.h"
+
+bool HuffmanDecoder::build(const HuffmanTable& table) {
+    maxLength = table.maxLength();
+    if (maxLength == 0 || maxLength > MAX_CODE_LENGTH || table.symbols.empty()) {
+        return false;
+    }
+    symbols = table.symbols;
+    for (uint8_t symbol : symbols) {
+        if (symbol >= DHC_ALPHABET_SIZE) return false;
+    }
+
+    // First code and first symbol index of every length
+    uint64_t code = 0;
+    uint32_t index = 0;
+    for (unsigned len = 1; len <= maxLength; len++) {
+        firstCode[len] = code;
+        firstIndex[len] = index;
+        countAtLength[len] = table.lengthCounts[len];
+        code = (code + countAtLength[len]) << 1;
+        index += countAtLength[len];
+    }
+    if (index != symbols.size()) return false;
+
+    // Single-symbol entries: every window starting with a short code maps to it
+    lookupBits = maxLength < LOOKUP_BITS ? maxLength : LOOKUP_BITS;
+    lookup.assign(1u << lookupBits, Entry{{0, 0}, 0, 0, 0, 0});
+    for (unsigned len = 1; len <= lookupBits; len++) {
+        for (uint32_t i = 0; i < countAtLength[len]; i++) {
+            const DhcSymbolInfo& info = dhcAlphabet.symbols[symbols[firstIndex[len] + i]];
+            uint32_t first = static_cast<uint32_t>(firstCode[len] + i) << (lookupBits - len);
+            uint32_t last = first + (1u << (lookupBits - len));
+            for (uint32_t w = first; w < last; w++) {
+                lookup[w] = Entry{{info.base, 0}, static_cast<uint8_t>(len), static_cast<uint8_t>(len), 1,
+                                  info.extraBits};
+            }
+        }
+    }
+
+    // Pair entries: if the first symbol is a plain delta and the bits left
+    // after its code hold another full code
+    const uint32_t mask = (1u << lookupBits) - 1;
+    for (uint32_t w = 0; w <= mask; w++) {
+        Entry& entry = lookup[w];
+        if (entry.count != 1 || entry.extraBits != 0 || entry.firstLength >= lookupBits) continue;
+        const Entry& next = lookup[(w << entry.firstLength) & mask];
+        if (next.firstLength == 0 || entry.firstLength + next.firstLength > lookupBits) continue;
+        entry.bases[1] = next.bases[0];
+        entry.totalLength = entry.firstLength + next.firstLength;
+        entry.count = 2;
+        // A window already turned into a pair starts with a plain delta
+        entry.extraBits = next.count == 1 ? next.extraBits : 0;
+    }
+    return true;
+}
+
+bool HuffmanDecoder::decodeLong(BitReader& reader, int16_t& delta) const {
+    for (unsigned len = lookupBits + 1; len <= maxLength; len++) {
+        uint64_t offset = reader.peek(len) - firstCode[len];
+        if (offset < countAtLength[len]) {
+            const DhcSymbolInfo& info = dhcAlphabet.symbols[symbols[firstIndex[len] + offset]];
+            reader.skip(len);
+            delta = info.base;
+            if (info.extraBits) delta += static_cast<int16_t>(reader.read(info.extraBits));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HuffmanDecoder::decode(BitReader& reader, int16_t* output, size_t count) const {
+    const Entry* table = lookup.data();
+    size_t i = 0;
+    while (i + 1 < count) {
+        reader.refill();
+        const Entry& entry = table[reader.peek(lookupBits)];
+        if (entry.count == 2) {
+            output[i] = entry.bases[0];
+            reader.skip(entry.totalLength);
+            int16_t delta = entry.bases[1];
+            if (entry.extraBits) delta += static_cast<int16_t>(reader.read(entry.extraBits));
+            output[i + 1] = delta;
+            i += 2;
+        } else if (entry.count == 1) {
+            reader.skip(entry.firstLength);
+            int16_t delta = entry.bases[0];
+            if (entry.extraBits) delta += static_cast<int16_t>(reader.read(entry.extraBits));
+            output[i++] = delta;
+        } else if (!decodeLong(reader, output[i++])) {
+            return false;
+        }
+    }
+    if (i < count) {
+        // Last symbol: never take the second half of a pair
+        reader.refill();
+        const Entry& entry = table[reader.peek(lookupBits)];
+        if (entry.count > 0) {
+            reader.skip(entry.firstLength);
+            const uint8_t extraBits = entry.count == 1 ? entry.extraBits : 0;
+            int16_t delta = entry.bases[0];
+            if (extraBits) delta += static_cast<int16_t>(reader.read(extraBits));
+            output[i] = delta;
+        } else if (!decodeLong(reader, output[i])) {
+            return false;
+        }
+    }
+    return !reader.overrun();
+}
+
+void huffmanCodeLengths(uint32_t* weights, size_t count) {
+    uint32_t* a = weights;
+    if (count == 0) return;
+    if (count == 1) {
+        a[0] = 1;
+        return;
+    }
+
+    // First pass, left to right: combine the two lightest nodes, leaving
+    // parent pointers in place of the internal node weights
+    a[0] += a[1];
+    size_t root = 0;
+    size_t leaf = 2;
+    for (size_t next = 1; next < count - 1; next++) {
+        if (leaf >= count || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = static_cast<uint32_t>(next);
+        } else {
+            a[next] = a[leaf++];
+        }
+        if (leaf >= count || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = static_cast<uint32_t>(next);
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+
+    // Second pass, right to left: depth of every internal node
+    a[count - 2] = 0;
+    for (size_t next = count - 2; next-- > 0;) {
+        a[next] = a[a[next]] + 1;
+    }
+
+    // Third pass, right to left: depth of every leaf
+    size_t available = 1;
+    size_t used = 0;
+    uint32_t depth = 0;
+    ptrdiff_t rootIndex = static_cast<ptrdiff_t>(count) - 2;
+    ptrdiff_t next = static_cast<ptrdiff_t>(count) - 1;
+    while (available > 0) {
+        while (rootIndex >= 0 && a[rootIndex] == depth) {
+            used++;
+            rootIndex--;
+        }
+        while (available > used) {
+            a[next--] = depth;
+            available--;
+        }
+        available = 2 * used;
+        depth++;
+        used = 0;
+    }
+}
+
+void huffmanLimitCodeLengths(uint32_t* lengths, size_t count, unsigned maxLength) {
+    // Kraft sum in units of 2^-maxLength; a complete code sums to exactly one
+    const uint64_t one = uint64_t(1) << maxLength;
+    uint64_t kraft = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (lengths[i] > maxLength) lengths[i] = maxLength;
+        kraft += one >> lengths[i];
+    }
+
+    // Over-subscribed: lengthen the lightest of the longest codes below the
+    // limit, which costs the least. Lengths stay non-increasing.
+    size_t i = 0;
+    while (kraft > one) {
+        while (lengths[i] == maxLength) i++;
+        lengths[i]++;
+        kraft -= one >> lengths[i];
+    }
+
+    // Spend any slack on shortening the heaviest codes
+    for (size_t j = count; j-- > 0;) {
+        while (lengths[j] > 1 && kraft + (one >> lengths[j]) <= one) {
+            kraft += one >> lengths[j];
+            lengths[j]--;
+        }
+    }
+}
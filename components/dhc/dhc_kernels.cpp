@@ -0,0 +1,185 @@
+#include "dhc_kernels.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DHC_KERNELS_X86 1
+#if defined(__SSE2__)
+#define DHC_KERNELS_SSE2 1
+#endif
+#if defined(__GNUC__)
+// Compiled for AVX2 regardless of the build flags, used only if the CPU has it
+#define DHC_KERNELS_AVX2 1
+#define DHC_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DHC_KERNELS_NEON 1
+#endif
+
+// Scalar versions; also finish the tails of the vector loops
+
+static void deltaScalar(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t sample;
+        memcpy(&sample, input + i * sizeof(uint16_t), sizeof(sample));
+        deltas[i] = static_cast<int16_t>(sample - previous);
+        previous = sample;
+    }
+}
+
+static void prefixSumScalar(const int16_t* deltas, size_t count, uint16_t previous, uint8_t* output) {
+    for (size_t i = 0; i < count; i++) {
+        previous = static_cast<uint16_t>(previous + deltas[i]);
+        memcpy(output + i * sizeof(uint16_t), &previous, sizeof(previous));
+    }
+}
+
+static uint16_t loadSample(const uint8_t* data, size_t index) {
+    uint16_t sample;
+    memcpy(&sample, data + index * sizeof(uint16_t), sizeof(sample));
+    return sample;
+}
+
+#if DHC_KERNELS_SSE2
+// Each vector subtracts the same samples loaded one lane earlier
+static void deltaSse2(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas) {
+    if (count == 0) return;
+    deltas[0] = static_cast<int16_t>(loadSample(input, 0) - previous);
+    size_t i = 1;
+    for (; i + 8 <= count; i += 8) {
+        __m128i current = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 2 * i));
+        __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + 2 * i - 2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(deltas + i), _mm_sub_epi16(current, before));
+    }
+    deltaScalar(input + 2 * i, count - i, loadSample(input, i - 1), deltas + i);
+}
+
+// Log-step scan within a vector, then the running total is added to all lanes
+static void prefixSumSse2(const int16_t* deltas, size_t count, uint16_t previous, uint8_t* output) {
+    __m128i carry = _mm_set1_epi16(static_cast<int16_t>(previous));
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(deltas + i));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi16(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output + 2 * i), x);
+        __m128i last = _mm_shufflehi_epi16(x, 0xFF);
+        carry = _mm_unpackhi_epi64(last, last);
+    }
+    if (i > 0) previous = loadSample(output, i - 1);
+    prefixSumScalar(deltas + i, count - i, previous, output + 2 * i);
+}
+#endif
+
+#if DHC_KERNELS_AVX2
+DHC_TARGET_AVX2
+static void deltaAvx2(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas) {
+    if (count == 0) return;
+    deltas[0] = static_cast<int16_t>(loadSample(input, 0) - previous);
+    size_t i = 1;
+    for (; i + 16 <= count; i += 16) {
+        __m256i current = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + 2 * i));
+        __m256i before = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + 2 * i - 2));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(deltas + i), _mm256_sub_epi16(current, before));
+    }
+    deltaScalar(input + 2 * i, count - i, loadSample(input, i - 1), deltas + i);
+}
+
+// Byte shifts work per 128-bit lane, so the low lane's total is carried into the high one
+DHC_TARGET_AVX2
+static void prefixSumAvx2(const int16_t* deltas, size_t count, uint16_t previous, uint8_t* output) {
+    __m256i carry = _mm256_set1_epi16(static_cast<int16_t>(previous));
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(deltas + i));
+        x = _mm256_add_epi16(x, _mm256_slli_si256(x, 2));
+        x = _mm256_add_epi16(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi16(x, _mm256_slli_si256(x, 8));
+        __m256i laneLast = _mm256_shufflehi_epi16(x, 0xFF);
+        laneLast = _mm256_unpackhi_epi64(laneLast, laneLast);
+        x = _mm256_add_epi16(x, _mm256_permute2x128_si256(laneLast, laneLast, 0x08));
+        x = _mm256_add_epi16(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + 2 * i), x);
+        __m256i last = _mm256_shufflehi_epi16(x, 0xFF);
+        last = _mm256_unpackhi_epi64(last, last);
+        carry = _mm256_permute2x128_si256(last, last, 0x11);
+    }
+    if (i > 0) previous = loadSample(output, i - 1);
+    prefixSumScalar(deltas + i, count - i, previous, output + 2 * i);
+}
+#endif
+
+#if DHC_KERNELS_NEON
+static void deltaNeon(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas) {
+    if (count == 0) return;
+    deltas[0] = static_cast<int16_t>(loadSample(input, 0) - previous);
+    size_t i = 1;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t current = vreinterpretq_u16_u8(vld1q_u8(input + 2 * i));
+        uint16x8_t before = vreinterpretq_u16_u8(vld1q_u8(input + 2 * i - 2));
+        vst1q_s16(deltas + i, vreinterpretq_s16_u16(vsubq_u16(current, before)));
+    }
+    deltaScalar(input + 2 * i, count - i, loadSample(input, i - 1), deltas + i);
+}
+
+static void prefixSumNeon(const int16_t* deltas, size_t count, uint16_t previous, uint8_t* output) {
+    const uint16x8_t zero = vdupq_n_u16(0);
+    uint16x8_t carry = vdupq_n_u16(previous);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t x = vreinterpretq_u16_s16(vld1q_s16(deltas + i));
+        x = vaddq_u16(x, vextq_u16(zero, x, 7));
+        x = vaddq_u16(x, vextq_u16(zero, x, 6));
+        x = vaddq_u16(x, vextq_u16(zero, x, 4));
+        x = vaddq_u16(x, carry);
+        vst1q_u8(output + 2 * i, vreinterpretq_u8_u16(x));
+        carry = vdupq_n_u16(vgetq_lane_u16(x, 7));
+    }
+    if (i > 0) previous = loadSample(output, i - 1);
+    prefixSumScalar(deltas + i, count - i, previous, output + 2 * i);
+}
+#endif
+
+static const DhcKernels kScalar = {"scalar", deltaScalar, prefixSumScalar};
+#if DHC_KERNELS_SSE2
+static const DhcKernels kSse2 = {"sse2", deltaSse2, prefixSumSse2};
+#endif
+#if DHC_KERNELS_AVX2
+static const DhcKernels kAvx2 = {"avx2", deltaAvx2, prefixSumAvx2};
+#endif
+#if DHC_KERNELS_NEON
+static const DhcKernels kNeon = {"neon", deltaNeon, prefixSumNeon};
+#endif
+
+size_t dhcKernelVariants(const DhcKernels** variants, size_t max_variants) {
+    const DhcKernels* all[4];
+    size_t count = 0;
+    all[count++] = &kScalar;
+#if DHC_KERNELS_SSE2
+    all[count++] = &kSse2;
+#endif
+#if DHC_KERNELS_AVX2
+    if (__builtin_cpu_supports("avx2")) all[count++] = &kAvx2;
+#endif
+#if DHC_KERNELS_NEON
+    all[count++] = &kNeon;
+#endif
+    size_t n = count < max_variants ? count : max_variants;
+    for (size_t i = 0; i < n; i++) {
+        variants[i] = all[i];
+    }
+    return count;
+}
+
+const DhcKernels& dhcKernels() {
+    // Variants are listed slowest first
+    static const DhcKernels* best = [] {
+        const DhcKernels* variants[4];
+        size_t count = dhcKernelVariants(variants, 4);
+        return variants[count - 1];
+    }();
+    return *best;
+}
@@ -0,0 +1,722 @@
+#include "dhc_parallel.h"
+#include "dhc_file_io.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include <algorithm>
+
+#if defined(ESP_PLATFORM)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#else
+#include <thread>
+#endif
+
+#define TAG "DHC_PARALLEL"
+
+// Samples per decode job; decoding a block is quick, so jobs gather several
+static const size_t DECODE_JOB_SAMPLES = 16384;
+
+#if defined(ESP_PLATFORM)
+static const uint32_t WORKER_STACK_SIZE = 4096;
+#endif
+
+static inline uint32_t readU32(const uint8_t* in) {
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+           (static_cast<uint32_t>(in[2]) << 8) | in[3];
+}
+
+struct DHCParallel::Worker {
+    DHCParallel* owner;
+    DHC codec;
+#if !defined(ESP_PLATFORM)
+    std::thread thread;
+#endif
+};
+
+// Cuts a sequence of blocks into decode jobs of whole channel groups. A reuse
+// block refers to the last table sent on its channel; when that table was sent
+// before the job, the job carries a copy of it and so decodes on its own.
+struct DHCParallel::DecodeSplitter {
+    unsigned channels;
+    unsigned channel = 0;                      // of the next block
+    std::vector<std::vector<uint8_t>> tables;  // header and table of every channel's last dynamic block
+    std::vector<bool> tableInJob;              // the channel's table is part of the current job
+    std::vector<uint8_t> context;              // earlier tables the current job refers to
+    size_t samples = 0;                        // in the current job
+
+    explicit DecodeSplitter(unsigned count) : channels(count), tables(count), tableInJob(count, false) {}
+
+    // Adds a complete block; true once the job is worth queuing
+    bool add(const uint8_t* block, size_t length) {
+        uint8_t blockType = block[8] & DHC::BLOCK_TYPE_MASK;
+        if (blockType == DHC::BLOCK_DYNAMIC) {
+            tables[channel].assign(block, block + length - readU32(block + 4));
+            tableInJob[channel] = true;
+        } else if (blockType == DHC::BLOCK_REUSE && !tableInJob[channel] && !tables[channel].empty()) {
+            context.push_back(static_cast<uint8_t>(channel));
+            context.insert(context.end(), tables[channel].begin(), tables[channel].end());
+            tableInJob[channel] = true;
+        }
+        samples += readU32(block);
+        channel = (channel + 1) % channels;
+        return channel == 0 && samples >= DECODE_JOB_SAMPLES;
+    }
+};
+
+DHCParallel::DHCParallel(unsigned workers, unsigned max_in_flight) {
+    if (workers == 0) {
+#if defined(ESP_PLATFORM)
+        workers = portNUM_PROCESSORS;
+#else
+        workers = std::max(1u, std::thread::hardware_concurrency());
+#endif
+    }
+    slots.resize(max_in_flight > 0 ? max_in_flight : 2 * workers);
+    startWorkers(workers);
+}
+
+DHCParallel::~DHCParallel() {
+    drain();
+    stopWorkers();
+}
+
+void DHCParallel::startWorkers(unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->owner = this;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running++;
+        }
+#if defined(ESP_PLATFORM)
+        // Last core first, below the caller's priority: acquisition keeps core 0
+        BaseType_t core = portNUM_PROCESSORS - 1 - i % portNUM_PROCESSORS;
+        UBaseType_t priority = uxTaskPriorityGet(nullptr);
+        priority = priority > 1 ? priority - 1 : 1;
+        if (xTaskCreatePinnedToCore(workerEntry, "dhc_worker", WORKER_STACK_SIZE, worker.get(), priority, nullptr,
+                                    core) != pdPASS) {
+            ESP_LOGE(TAG, "Failed to start worker %u", i);
+            std::lock_guard<std::mutex> guard(lock);
+            running--;
+            break;
+        }
+#else
+        worker->thread = std::thread(workerEntry, worker.get());
+#endif
+        pool.push_back(std::move(worker));
+    }
+}
+
+void DHCParallel::stopWorkers() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        slotChanged.wait(guard, [this] { return running == 0; });
+    }
+#if !defined(ESP_PLATFORM)
+    for (std::unique_ptr<Worker>& worker : pool) {
+        worker->thread.join();
+    }
+#endif
+    pool.clear();
+}
+
+void DHCParallel::workerEntry(void* context) {
+    Worker* worker = static_cast<Worker*>(context);
+    worker->owner->workerLoop(worker->codec);
+#if defined(ESP_PLATFORM)
+    vTaskDelete(nullptr);
+#endif
+}
+
+void DHCParallel::workerLoop(DHC& codec) {
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        workAvailable.wait(guard, [this] { return stopping || started < filled; });
+        if (started == filled) break;
+        Slot& slot = slots[started++ % slots.size()];
+        slot.state = SLOT_BUSY;
+        guard.unlock();
+        bool ok = runJob(codec, slot);
+        guard.lock();
+        slot.ok = ok;
+        slot.state = SLOT_DONE;
+        slotChanged.notify_all();
+    }
+    running--;
+    slotChanged.notify_all();
+}
+
+// Blocks of up to blockFrames frames, one per channel for every range
+bool DHCParallel::appendFrames(DHC& codec, const uint8_t* input, size_t frames, unsigned channels,
+                               size_t blockFrames, std::vector<uint8_t>& output) {
+    for (size_t first = 0; first < frames; first += blockFrames) {
+        size_t count = std::min(blockFrames, frames - first);
+        for (unsigned channel = 0; channel < channels; channel++) {
+            const uint8_t* samples = input + (first * channels + channel) * sizeof(uint16_t);
+            if (!codec.appendBlock(samples, count, channels, 0, channel, output)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool DHCParallel::runJob(DHC& codec, Slot& slot) {
+    switch (slot.kind) {
+    case JOB_BLOCKS:
+        slot.output.clear();
+        return appendFrames(codec, slot.input, slot.size, slot.channels, slot.size, slot.output);
+    case JOB_CHUNK: {
+        // A whole compress() output: magic (and channel count), then blocks
+        slot.output.clear();
+        uint16_t magic = slot.channels > 1 ? DHC::CHANNELS_MAGIC : DHC::MAGIC;
+        slot.output.push_back(static_cast<uint8_t>(magic >> 8));
+        slot.output.push_back(static_cast<uint8_t>(magic & 0xFF));
+        if (slot.channels > 1) {
+            slot.output.push_back(static_cast<uint8_t>(slot.channels));
+        }
+        size_t frames = slot.size / (slot.channels * sizeof(uint16_t));
+        return appendFrames(codec, slot.input, frames, slot.channels, DHC::MAX_BLOCK_SAMPLES, slot.output);
+    }
+    default:
+        return decodeJob(codec, slot);
+    }
+}
+
+bool DHCParallel::decodeJob(DHC& codec, Slot& slot) {
+    // Tables sent before the job come first
+    codec.resetTableReuse();
+    const std::vector<uint8_t>& context = slot.context;
+    for (size_t pos = 0; pos < context.size();) {
+        unsigned channel = context[pos++];
+        size_t length;
+        if (!codec.blockLength(context.data() + pos, context.size() - pos, &length)) {
+            return false;
+        }
+        size_t tableLength = length - readU32(context.data() + pos + 4);
+        if (!codec.loadBlockTable(context.data() + pos, tableLength, channel)) {
+            return false;
+        }
+        pos += tableLength;
+    }
+
+    // Whole groups of one block per channel, decoded straight into their frames;
+    // the output was sized from the block headers
+    const size_t frameBytes = slot.channels * sizeof(uint16_t);
+    size_t written = 0;
+    size_t pos = 0;
+    while (pos < slot.size) {
+        size_t frames = 0;
+        for (unsigned channel = 0; channel < slot.channels; channel++) {
+            size_t length;
+            if (!codec.blockLength(slot.input + pos, slot.size - pos, &length) || length > slot.size - pos) {
+                ESP_LOGE(TAG, "Truncated or invalid block");
+                return false;
+            }
+            size_t count = readU32(slot.input + pos);
+            if (channel == 0) {
+                frames = count;
+                if ((slot.output.size() - written) / frameBytes < frames) {
+                    ESP_LOGE(TAG, "Channel blocks differ in length");
+                    return false;
+                }
+            } else if (count != frames) {
+                ESP_LOGE(TAG, "Channel blocks differ in length");
+                return false;
+            }
+            uint8_t* samples = slot.output.data() + written + channel * sizeof(uint16_t);
+            if (!codec.decodeBlock(slot.input + pos, length, 0, channel, samples, slot.channels)) {
+                return false;
+            }
+            pos += length;
+        }
+        written += frames * frameBytes;
+    }
+    slot.output.resize(written);
+    return true;
+}
+
+bool DHCParallel::ringFull() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return filled - consumed >= slots.size();
+}
+
+size_t DHCParallel::outstanding() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return static_cast<size_t>(filled - consumed);
+}
+
+void DHCParallel::queueSlot() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        slots[filled % slots.size()].state = SLOT_QUEUED;
+        filled++;
+    }
+    workAvailable.notify_one();
+}
+
+DHCParallel::Slot& DHCParallel::waitOldest() {
+    std::unique_lock<std::mutex> guard(lock);
+    Slot& slot = slots[consumed % slots.size()];
+    slotChanged.wait(guard, [&slot] { return slot.state == SLOT_DONE; });
+    return slot;
+}
+
+void DHCParallel::releaseOldest() {
+    std::lock_guard<std::mutex> guard(lock);
+    slots[consumed % slots.size()].state = SLOT_FREE;
+    consumed++;
+}
+
+void DHCParallel::drain() {
+    while (outstanding() > 0) {
+        waitOldest();
+        releaseOldest();
+    }
+}
+
+bool DHCParallel::ready(const char* operation) const {
+    if (pool.empty()) {
+        ESP_LOGE(TAG, "No workers for %s", operation);
+        return false;
+    }
+    if (outstanding() > 0) {
+        ESP_LOGE(TAG, "Submitted chunks are outstanding, %s refused", operation);
+        return false;
+    }
+    return true;
+}
+
+void DHCParallel::set_engine(DHC::Engine engine) {
+    for (std::unique_ptr<Worker>& worker : pool) {
+        worker->codec.set_engine(engine);
+    }
+}
+
+bool DHCParallel::set_predictor(unsigned order) {
+    for (std::unique_ptr<Worker>& worker : pool) {
+        if (!worker->codec.set_predictor(order)) return false;
+    }
+    return true;
+}
+
+bool DHCParallel::set_static_table(uint8_t table_id) {
+    for (std::unique_ptr<Worker>& worker : pool) {
+        if (!worker->codec.set_static_table(table_id)) return false;
+    }
+    return true;
+}
+
+bool DHCParallel::set_channels(unsigned channels) {
+    if (channels == 0 || channels > DHC::MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Invalid channel count: %u", channels);
+        return false;
+    }
+    channelCount = channels;
+    return true;
+}
+
+bool DHCParallel::set_block_samples(size_t block_samples) {
+    if (block_samples == 0 || block_samples > DHC::MAX_BLOCK_SAMPLES) {
+        ESP_LOGE(TAG, "Invalid block size: %u", (unsigned)block_samples);
+        return false;
+    }
+    blockSamples = block_samples;
+    return true;
+}
+
+bool DHCParallel::compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
+    if (!input || !output || !output_size || input_size < 2) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    const size_t frameBytes = channelCount * sizeof(uint16_t);
+    if (input_size % frameBytes != 0) {
+        ESP_LOGE(TAG, "Input is not a whole number of %u-channel frames", channelCount);
+        return false;
+    }
+    if (!ready("compress")) {
+        return false;
+    }
+
+    // Magic number (and channel count) as DHC::compress writes them
+    size_t pos = channelCount > 1 ? 3 : 2;
+    if (*output_size < pos) {
+        ESP_LOGE(TAG, "Output buffer too small");
+        return false;
+    }
+    uint16_t magic = channelCount > 1 ? DHC::CHANNELS_MAGIC : DHC::MAGIC;
+    output[0] = static_cast<uint8_t>(magic >> 8);
+    output[1] = static_cast<uint8_t>(magic & 0xFF);
+    if (channelCount > 1) {
+        output[2] = static_cast<uint8_t>(channelCount);
+    }
+
+    // Reorder stage: finished jobs are appended strictly in input order
+    bool ok = true;
+    auto emitOldest = [&]() {
+        Slot& slot = waitOldest();
+        if (ok && !slot.ok) {
+            ok = false;
+        } else if (ok && slot.output.size() > *output_size - pos) {
+            ESP_LOGE(TAG, "Output buffer too small");
+            ok = false;
+        } else if (ok) {
+            memcpy(output + pos, slot.output.data(), slot.output.size());
+            pos += slot.output.size();
+        }
+        releaseOldest();
+    };
+
+    const size_t frames = input_size / frameBytes;
+    for (size_t first = 0; first < frames && ok; first += blockSamples) {
+        if (ringFull()) emitOldest();
+        Slot& slot = nextSlot();
+        slot.kind = JOB_BLOCKS;
+        slot.input = input + first * frameBytes;
+        slot.size = std::min(blockSamples, frames - first);
+        slot.channels = channelCount;
+        queueSlot();
+    }
+    while (outstanding() > 0) {
+        emitOldest();
+    }
+
+    *output_size = pos;
+    return ok;
+}
+
+size_t DHCParallel::compress_bound(size_t input_size) const {
+    size_t frames = input_size / (channelCount * sizeof(uint16_t));
+    return (channelCount > 1 ? 3 : 2) + DHC::blocksBound(frames, channelCount, blockSamples);
+}
+
+bool DHCParallel::queueDecodeJob(DecodeSplitter& splitter, const uint8_t* input, size_t size) {
+    Slot& slot = nextSlot();
+    slot.kind = JOB_DECODE;
+    slot.input = input;
+    slot.size = size;
+    slot.channels = splitter.channels;
+    slot.context.swap(splitter.context);
+    splitter.context.clear();
+    slot.output.resize(splitter.samples * sizeof(uint16_t));
+    queueSlot();
+
+    splitter.samples = 0;
+    std::fill(splitter.tableInJob.begin(), splitter.tableInJob.end(), false);
+    return true;
+}
+
+bool DHCParallel::decompress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size) {
+    if (!input || !output || !output_size || input_size < 2 + DHC::BLOCK_HEADER_SIZE) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    if (!ready("decompress")) {
+        return false;
+    }
+
+    // Verify magic number, multi-channel data carries its channel count
+    uint16_t magic = static_cast<uint16_t>((input[0] << 8) | input[1]);
+    unsigned channels = 1;
+    size_t pos = 2;
+    if (magic == DHC::CHANNELS_MAGIC) {
+        channels = input[pos++];
+        if (channels == 0 || channels > DHC::MAX_CHANNELS) {
+            ESP_LOGE(TAG, "Invalid channel count: %u", channels);
+            return false;
+        }
+    } else if (magic == DHC::FORMAT_MAGIC) {
+        ESP_LOGE(TAG, "Parallel decoding takes 16-bit samples");
+        return false;
+    } else if (magic != DHC::MAGIC) {
+        ESP_LOGE(TAG, "Invalid magic number");
+        return false;
+    }
+
+    // Decoded samples go to the output in job order
+    bool ok = true;
+    size_t written = 0;
+    auto emitOldest = [&]() {
+        Slot& slot = waitOldest();
+        if (ok && !slot.ok) {
+            ok = false;
+        } else if (ok && slot.output.size() > *output_size - written) {
+            ESP_LOGE(TAG, "Output buffer too small");
+            ok = false;
+        } else if (ok) {
+            memcpy(output + written, slot.output.data(), slot.output.size());
+            written += slot.output.size();
+        }
+        releaseOldest();
+    };
+
+    // Block headers are read here, payloads are decoded by the workers
+    const DHC& codec = pool.front()->codec;
+    DecodeSplitter splitter(channels);
+    size_t jobStart = pos;
+    while (pos < input_size && ok) {
+        size_t length;
+        if (!codec.blockLength(input + pos, input_size - pos, &length) || length > input_size - pos) {
+            ESP_LOGE(TAG, "Truncated or invalid block");
+            ok = false;
+            break;
+        }
+        bool full = splitter.add(input + pos, length);
+        pos += length;
+        if (full || pos == input_size) {
+            if (splitter.channel != 0) {
+                ESP_LOGE(TAG, "Truncated or invalid block");
+                ok = false;
+                break;
+            }
+            if (ringFull()) emitOldest();
+            queueDecodeJob(splitter, input + jobStart, pos - jobStart);
+            jobStart = pos;
+        }
+    }
+    while (outstanding() > 0) {
+        emitOldest();
+    }
+
+    *output_size = written;
+    return ok;
+}
+
+bool DHCParallel::compress_file(const char* input_file, const char* output_file) {
+    if (channelCount > 1) {
+        ESP_LOGE(TAG, "Files are single-channel");
+        return false;
+    }
+    if (!ready("compress_file")) {
+        return false;
+    }
+
+    FILE* in_file = fopen(input_file, "rb");
+    if (!in_file) {
+        ESP_LOGE(TAG, "Failed to open input file: %s", input_file);
+        return false;
+    }
+    FILE* out_file = fopen(output_file, "wb");
+    if (!out_file) {
+        ESP_LOGE(TAG, "Failed to open output file: %s", output_file);
+        fclose(in_file);
+        return false;
+    }
+
+    // Magic number and original file size, as DHC::compress_file writes them;
+    // the size is filled in at the end
+    uint32_t file_size = 0;
+    bool ok;
+    {
+        DHCFileReader reader(in_file, DHC::FILE_BUFFER_SIZE);
+        DHCFileWriter writer(out_file, DHC::FILE_BUFFER_SIZE);
+        uint8_t header[DHC::FILE_HEADER_SIZE] = {static_cast<uint8_t>(DHC::FILE_MAGIC >> 8),
+                                                 static_cast<uint8_t>(DHC::FILE_MAGIC & 0xFF)};
+        ok = writer.write(header, sizeof(header));
+
+        // Blocks come out in order, so the seek index is built as they are written
+        std::vector<uint8_t> index;
+        uint32_t offset = DHC::FILE_HEADER_SIZE;
+        uint32_t firstSample = 0;
+        auto emitOldest = [&]() {
+            Slot& slot = waitOldest();
+            if (ok && (!slot.ok || !writer.write(slot.output.data(), slot.output.size()))) {
+                ESP_LOGE(TAG, "Failed to write compressed block");
+                ok = false;
+            }
+            if (ok) {
+                DHC::appendIndexEntry(index, DHC::IndexEntry{offset, firstSample, 0});
+                offset += slot.output.size();
+                firstSample += slot.size;
+            }
+            releaseOldest();
+        };
+
+        // One block per chunk, read straight into the job that compresses it
+        while (ok) {
+            if (ringFull()) emitOldest();
+            Slot& slot = nextSlot();
+            slot.owned.resize(DHC::CHUNK_SIZE);
+            size_t bytes_read = reader.read(slot.owned.data(), DHC::CHUNK_SIZE);
+            file_size += bytes_read;
+            if (bytes_read % 2 != 0) {
+                // Only the last chunk can be short; its odd byte would be lost
+                ESP_LOGE(TAG, "File ends in half a sample");
+                ok = false;
+                break;
+            }
+            if (bytes_read < 2) break;
+            slot.kind = JOB_BLOCKS;
+            slot.input = slot.owned.data();
+            slot.size = bytes_read / 2;
+            slot.channels = 1;
+            queueSlot();
+        }
+        while (outstanding() > 0) {
+            emitOldest();
+        }
+        if (reader.failed()) {
+            ESP_LOGE(TAG, "Failed to read input file: %s", input_file);
+            ok = false;
+        }
+        ok = ok && DHC::writeFileIndex(writer, index, offset);
+        ok = writer.finish() && ok;
+    }
+
+    uint8_t size_bytes[4] = {static_cast<uint8_t>(file_size >> 24), static_cast<uint8_t>(file_size >> 16),
+                             static_cast<uint8_t>(file_size >> 8), static_cast<uint8_t>(file_size)};
+    ok = ok && fseek(out_file, 2, SEEK_SET) == 0 && fwrite(size_bytes, 1, 4, out_file) == 4;
+
+    fclose(in_file);
+    if (fclose(out_file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        remove(output_file);  // Delete the output file if compression failed
+    }
+    return ok;
+}
+
+bool DHCParallel::decompress_file(const char* input_file, const char* output_file) {
+    if (!ready("decompress_file")) {
+        return false;
+    }
+    FILE* in_file = fopen(input_file, "rb");
+    if (!in_file) {
+        ESP_LOGE(TAG, "Failed to open input file: %s", input_file);
+        return false;
+    }
+
+    // Magic number and original file size, then the seek index for the block count
+    uint8_t header[DHC::FILE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), in_file) != sizeof(header) ||
+        ((header[0] << 8) | header[1]) != DHC::FILE_MAGIC) {
+        ESP_LOGE(TAG, "Invalid magic number");
+        fclose(in_file);
+        return false;
+    }
+    std::vector<DHC::IndexEntry> entries;
+    uint32_t index_offset;
+    if (!DHC::readFileIndex(in_file, entries, &index_offset) ||
+        fseek(in_file, DHC::FILE_HEADER_SIZE, SEEK_SET) != 0) {
+        ESP_LOGE(TAG, "Invalid seek index");
+        fclose(in_file);
+        return false;
+    }
+    FILE* out_file = fopen(output_file, "wb");
+    if (!out_file) {
+        ESP_LOGE(TAG, "Failed to open output file: %s", output_file);
+        fclose(in_file);
+        return false;
+    }
+
+    bool ok = true;
+    {
+        DHCFileReader reader(in_file, DHC::FILE_BUFFER_SIZE);
+        DHCFileWriter writer(out_file, DHC::FILE_BUFFER_SIZE);
+        auto emitOldest = [&]() {
+            Slot& slot = waitOldest();
+            if (ok && !slot.ok) {
+                ok = false;
+            } else if (ok && !writer.write(slot.output.data(), slot.output.size())) {
+                ESP_LOGE(TAG, "Failed to write decompressed samples");
+                ok = false;
+            }
+            releaseOldest();
+        };
+
+        // Blocks are read one after another into the pending job, which is handed
+        // to the workers once large enough
+        const DHC& codec = pool.front()->codec;
+        DecodeSplitter splitter(1);
+        std::vector<uint8_t> pending;
+        for (size_t block = 0; ok && block < entries.size(); block++) {
+            size_t start = pending.size();
+            size_t available = 0;
+            size_t length = 0;
+            while (true) {
+                if (!codec.blockLength(pending.data() + start, available, &length)) {
+                    ESP_LOGE(TAG, "Invalid block header");
+                    ok = false;
+                    break;
+                }
+                if (length <= available) break;
+                pending.resize(start + length);
+                if (reader.read(pending.data() + start + available, length - available) != length - available) {
+                    ESP_LOGE(TAG, "Truncated block");
+                    ok = false;
+                    break;
+                }
+                available = length;
+            }
+            if (!ok) break;
+
+            if (splitter.add(pending.data() + start, length)) {
+                if (ringFull()) emitOldest();
+                Slot& slot = nextSlot();
+                slot.owned.swap(pending);
+                pending.clear();
+                queueDecodeJob(splitter, slot.owned.data(), slot.owned.size());
+            }
+        }
+        if (ok && !pending.empty()) {
+            if (ringFull()) emitOldest();
+            Slot& slot = nextSlot();
+            slot.owned.swap(pending);
+            queueDecodeJob(splitter, slot.owned.data(), slot.owned.size());
+        }
+        while (outstanding() > 0) {
+            emitOldest();
+        }
+        ok = writer.finish() && ok;
+    }
+
+    fclose(in_file);
+    if (fclose(out_file) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        remove(output_file);  // Delete the output file if decompression failed
+    }
+    return ok;
+}
+
+bool DHCParallel::submit(const uint8_t* input, size_t input_size) {
+    if (!input || input_size < 2 || input_size % (channelCount * sizeof(uint16_t)) != 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    if (pool.empty()) {
+        ESP_LOGE(TAG, "No workers for submit");
+        return false;
+    }
+    if (ringFull()) {
+        return false;
+    }
+    Slot& slot = nextSlot();
+    slot.kind = JOB_CHUNK;
+    slot.owned.assign(input, input + input_size);
+    slot.input = slot.owned.data();
+    slot.size = input_size;
+    slot.channels = channelCount;
+    queueSlot();
+    return true;
+}
+
+bool DHCParallel::next(std::vector<uint8_t>& compressed) {
+    if (outstanding() == 0) {
+        return false;
+    }
+    Slot& slot = waitOldest();
+    bool ok = slot.ok;
+    compressed.swap(slot.output);
+    releaseOldest();
+    return ok;
+}
@@ -0,0 +1,203 @@
+#include "dhc_predictor.h"
+#include <string.h>
+#include "dhc_samples.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+// Every loop below is a template over Samples, one plane of one sample layout
+// (dhc_samples.h), so each format gets its own branch-free copy
+
+// Prediction of the given order, h1 being the newest of the samples before
+static inline uint16_t prediction(unsigned order, uint16_t h1, uint16_t h2, uint16_t h3, uint16_t h4) {
+    switch (order) {
+    case 0:
+        return 0;
+    case 1:
+        return h1;
+    case 2:
+        return static_cast<uint16_t>(2 * h1 - h2);
+    case 3:
+        return static_cast<uint16_t>(3 * h1 - 3 * h2 + h3);
+    default:
+        return static_cast<uint16_t>(4 * h1 - 6 * h2 + 4 * h3 - h4);
+    }
+}
+
+// Contiguous samples are split out so that the compiler can vectorize the sums
+template <typename Samples, bool Contiguous>
+static unsigned chooseOrder(const uint8_t* input, size_t first, size_t count, size_t stride) {
+    if (Contiguous) stride = 1;
+    uint32_t sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0, sum4 = 0;
+    for (size_t i = DHC_MAX_PREDICTOR_ORDER; i < count; i++) {
+        int s0 = Samples::load(input, first + i * stride);
+        int s1 = Samples::load(input, first + (i - 1) * stride);
+        int s2 = Samples::load(input, first + (i - 2) * stride);
+        int s3 = Samples::load(input, first + (i - 3) * stride);
+        int s4 = Samples::load(input, first + (i - 4) * stride);
+        sum0 += abs(static_cast<int16_t>(s0));
+        sum1 += abs(static_cast<int16_t>(s0 - s1));
+        sum2 += abs(static_cast<int16_t>(s0 - 2 * s1 + s2));
+        sum3 += abs(static_cast<int16_t>(s0 - 3 * s1 + 3 * s2 - s3));
+        sum4 += abs(static_cast<int16_t>(s0 - 4 * s1 + 6 * s2 - 4 * s3 + s4));
+    }
+
+    // Ties go to order 1, which has the vector kernels
+    const uint32_t sums[DHC_MAX_PREDICTOR_ORDER + 1] = {sum0, sum1, sum2, sum3, sum4};
+    unsigned best = 1;
+    for (unsigned order = 0; order <= DHC_MAX_PREDICTOR_ORDER; order++) {
+        if (sums[order] < sums[best]) best = order;
+    }
+    return best;
+}
+
+template <typename Samples>
+static unsigned choosePredictor(const uint8_t* input, size_t first, size_t count, size_t stride) {
+    // Too short to tell the orders apart
+    if (count <= DHC_MAX_PREDICTOR_ORDER) return 1;
+    return stride == 1 ? chooseOrder<Samples, true>(input, first, count, 1)
+                       : chooseOrder<Samples, false>(input, first, count, stride);
+}
+
+template <typename Samples, unsigned Order>
+static void predictRun(const uint8_t* input, size_t first, size_t begin, size_t count, size_t stride,
+                       uint16_t* history, int16_t* residuals) {
+    uint16_t h1 = history[0], h2 = history[1], h3 = history[2], h4 = history[3];
+    for (size_t i = begin; i < count; i++) {
+        uint16_t sample = Samples::load(input, first + i * stride);
+        residuals[i] = static_cast<int16_t>(sample - prediction(Order, h1, h2, h3, h4));
+        h4 = h3;
+        h3 = h2;
+        h2 = h1;
+        h1 = sample;
+    }
+}
+
+template <typename Samples, unsigned Order>
+static void unpredictRun(const int16_t* residuals, size_t begin, size_t count, uint16_t* history, uint8_t* output,
+                         size_t first, size_t stride) {
+    uint16_t h1 = history[0], h2 = history[1], h3 = history[2], h4 = history[3];
+    for (size_t i = begin; i < count; i++) {
+        uint16_t sample = static_cast<uint16_t>(prediction(Order, h1, h2, h3, h4) + residuals[i]);
+        Samples::store(output, first + i * stride, sample);
+        h4 = h3;
+        h3 = h2;
+        h2 = h1;
+        h1 = sample;
+    }
+}
+
+// Samples before a full history is available; returns how many there were
+template <typename Samples>
+static size_t predictWarmUp(const uint8_t* input, size_t first, size_t count, size_t stride, unsigned order,
+                            uint16_t* history, int16_t* residuals) {
+    size_t warm = std::min<size_t>(count, order > 0 ? order - 1 : 0);
+    for (size_t i = 0; i < warm; i++) {
+        uint16_t sample = Samples::load(input, first + i * stride);
+        residuals[i] = static_cast<int16_t>(sample - prediction(i + 1, history[0], history[1], history[2], 0));
+        memmove(history + 1, history, 3 * sizeof(uint16_t));
+        history[0] = sample;
+    }
+    return warm;
+}
+
+template <typename Samples>
+static size_t unpredictWarmUp(const int16_t* residuals, size_t count, unsigned order, uint16_t* history,
+                              uint8_t* output, size_t first, size_t stride) {
+    size_t warm = std::min<size_t>(count, order > 0 ? order - 1 : 0);
+    for (size_t i = 0; i < warm; i++) {
+        uint16_t sample = static_cast<uint16_t>(prediction(i + 1, history[0], history[1], history[2], 0) +
+                                                residuals[i]);
+        Samples::store(output, first + i * stride, sample);
+        memmove(history + 1, history, 3 * sizeof(uint16_t));
+        history[0] = sample;
+    }
+    return warm;
+}
+
+template <typename Samples>
+static void predict(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                    unsigned order, int16_t* residuals) {
+    uint16_t history[4] = {previous, 0, 0, 0};
+    size_t begin = predictWarmUp<Samples>(input, first, count, stride, order, history, residuals);
+    switch (order) {
+    case 0:
+        predictRun<Samples, 0>(input, first, begin, count, stride, history, residuals);
+        break;
+    case 1:
+        predictRun<Samples, 1>(input, first, begin, count, stride, history, residuals);
+        break;
+    case 2:
+        predictRun<Samples, 2>(input, first, begin, count, stride, history, residuals);
+        break;
+    case 3:
+        predictRun<Samples, 3>(input, first, begin, count, stride, history, residuals);
+        break;
+    default:
+        predictRun<Samples, 4>(input, first, begin, count, stride, history, residuals);
+        break;
+    }
+}
+
+template <typename Samples>
+static void unpredict(const int16_t* residuals, size_t count, uint16_t previous, unsigned order, uint8_t* output,
+                      size_t first, size_t stride) {
+    uint16_t history[4] = {previous, 0, 0, 0};
+    size_t begin = unpredictWarmUp<Samples>(residuals, count, order, history, output, first, stride);
+    switch (order) {
+    case 0:
+        unpredictRun<Samples, 0>(residuals, begin, count, history, output, first, stride);
+        break;
+    case 1:
+        unpredictRun<Samples, 1>(residuals, begin, count, history, output, first, stride);
+        break;
+    case 2:
+        unpredictRun<Samples, 2>(residuals, begin, count, history, output, first, stride);
+        break;
+    case 3:
+        unpredictRun<Samples, 3>(residuals, begin, count, history, output, first, stride);
+        break;
+    default:
+        unpredictRun<Samples, 4>(residuals, begin, count, history, output, first, stride);
+        break;
+    }
+}
+
+template <unsigned Bits, bool Signed, bool BigEndian, unsigned Plane>
+static const DhcSampleCoder kCoder = {
+    Bits > 16 ? (Plane == 0 ? 16 : Bits - 16) : Bits,
+    choosePredictor<DhcSamplePlane<DhcSampleLayout<Bits, Signed, BigEndian>, Plane>>,
+    predict<DhcSamplePlane<DhcSampleLayout<Bits, Signed, BigEndian>, Plane>>,
+    unpredict<DhcSamplePlane<DhcSampleLayout<Bits, Signed, BigEndian>, Plane>>,
+    DhcSamplePlane<DhcSampleLayout<Bits, Signed, BigEndian>, Plane>::load,
+    Bits == 16 && BigEndian == DHC_HOST_BIG_ENDIAN,
+};
+
+const DhcSampleCoder* dhcSampleCoder(uint8_t format, unsigned plane) {
+    // Only instantiations that differ: signedness does not change the low 16
+    // bits, and single bytes have no byte order
+    const bool isSigned = format & DHC_SAMPLE_SIGNED;
+    const bool bigEndian = format & DHC_SAMPLE_BIG_ENDIAN;
+    switch (dhcSampleBits(format)) {
+    case 8:
+        if (plane == 0) return isSigned ? &kCoder<8, true, false, 0> : &kCoder<8, false, false, 0>;
+        break;
+    case 12:
+        if (plane == 0 && bigEndian) return isSigned ? &kCoder<12, true, true, 0> : &kCoder<12, false, true, 0>;
+        if (plane == 0) return isSigned ? &kCoder<12, true, false, 0> : &kCoder<12, false, false, 0>;
+        break;
+    case 16:
+        if (plane == 0) return bigEndian ? &kCoder<16, false, true, 0> : &kCoder<16, false, false, 0>;
+        break;
+    case 24:
+        if (plane == 0) return bigEndian ? &kCoder<24, false, true, 0> : &kCoder<24, false, false, 0>;
+        if (plane == 1 && bigEndian) return isSigned ? &kCoder<24, true, true, 1> : &kCoder<24, false, true, 1>;
+        if (plane == 1) return isSigned ? &kCoder<24, true, false, 1> : &kCoder<24, false, false, 1>;
+        break;
+    case 32:
+        if (plane == 0) return bigEndian ? &kCoder<32, false, true, 0> : &kCoder<32, false, false, 0>;
+        if (plane == 1) return bigEndian ? &kCoder<32, false, true, 1> : &kCoder<32, false, false, 1>;
+        break;
+    }
+    return nullptr;
+}
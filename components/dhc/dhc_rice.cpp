@@ -0,0 +1,105 @@
+#include "dhc_rice.h"
+
+#include <algorithm>
+
+// Mean bit length of the zig-zag values, minus one, is close to the best parameter
+static unsigned parameterFromLengths(uint64_t lengths, size_t count) {
+    uint64_t mean = (lengths + count / 2) / count;
+    return mean > 1 ? static_cast<unsigned>(std::min<uint64_t>(mean - 1, RICE_MAX_PARAMETER)) : 0;
+}
+
+static inline unsigned bitLength(uint32_t value) {
+    return 31 - __builtin_clz((value << 1) | 1);
+}
+
+unsigned riceParameter(const int16_t* deltas, size_t count) {
+    // Mean bit length rather than mean magnitude: a single large delta, such
+    // as the first one of a block, costs one escape and should not raise k
+    // for all the others
+    uint64_t lengths = 0;
+    for (size_t i = 0; i < count; i++) {
+        lengths += bitLength(riceZigZag(deltas[i]));
+    }
+    return parameterFromLengths(lengths, count);
+}
+
+// Zig-zag value of every alphabet symbol, magnitude classes by their middle value
+struct RiceSymbolValues {
+    uint32_t values[DHC_ALPHABET_SIZE];
+};
+
+static constexpr RiceSymbolValues makeRiceSymbolValues() {
+    RiceSymbolValues table{};
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        const DhcSymbolInfo& info = dhcAlphabet.symbols[symbol];
+        int delta = info.base + (info.extraBits ? 1 << (info.extraBits - 1) : 0);
+        table.values[symbol] = riceZigZag(static_cast<int16_t>(delta));
+    }
+    return table;
+}
+
+static constexpr RiceSymbolValues riceSymbolValues = makeRiceSymbolValues();
+
+unsigned riceEstimate(const uint32_t* frequencies, uint64_t* bits) {
+    // Seed from the mean bit length, then try the neighbours
+    uint64_t lengths = 0;
+    uint64_t count = 0;
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        lengths += static_cast<uint64_t>(frequencies[symbol]) * bitLength(riceSymbolValues.values[symbol]);
+        count += frequencies[symbol];
+    }
+    unsigned seed = parameterFromLengths(lengths, count);
+    unsigned first = seed > 0 ? seed - 1 : 0;
+    unsigned last = std::min(seed + 1, RICE_MAX_PARAMETER);
+
+    uint64_t cost[3] = {};
+    for (unsigned symbol = 0; symbol < DHC_ALPHABET_SIZE; symbol++) {
+        if (frequencies[symbol] == 0) continue;
+        for (unsigned k = first; k <= last; k++) {
+            cost[k - first] += static_cast<uint64_t>(frequencies[symbol]) *
+                               riceCodeLength(riceSymbolValues.values[symbol], k);
+        }
+    }
+    unsigned best = first;
+    for (unsigned k = first + 1; k <= last; k++) {
+        if (cost[k - first] < cost[best - first]) best = k;
+    }
+    *bits = cost[best - first];
+    return best;
+}
+
+void riceEncode(BitWriter& writer, const int16_t* deltas, size_t count, unsigned k) {
+    const uint32_t lowMask = (1u << k) - 1;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t value = riceZigZag(deltas[i]);
+        uint32_t quotient = value >> k;
+        if (quotient < RICE_ESCAPE_QUOTIENT) {
+            // quotient ones, a zero, then the low bits: one write of at most 31 bits
+            writer.write((((1u << quotient) - 1) << (k + 1)) | (value & lowMask), quotient + 1 + k);
+        } else {
+            writer.write((((1u << RICE_ESCAPE_QUOTIENT) - 1) << 16) | value, RICE_ESCAPE_QUOTIENT + 16);
+        }
+    }
+}
+
+bool riceDecode(BitReader& reader, int16_t* deltas, size_t count, unsigned k) {
+    if (k > RICE_MAX_PARAMETER) return false;
+    const uint32_t lowMask = (1u << k) - 1;
+    for (size_t i = 0; i < count; i++) {
+        // Every code fits the 32-bit window; count the leading ones, at most the escape
+        reader.refill();
+        uint32_t window = static_cast<uint32_t>(reader.peek(32));
+        unsigned quotient = __builtin_clz(~window | (1u << (31 - RICE_ESCAPE_QUOTIENT)));
+        uint32_t value;
+        if (quotient < RICE_ESCAPE_QUOTIENT) {
+            unsigned length = quotient + 1 + k;
+            value = (quotient << k) | ((window >> (32 - length)) & lowMask);
+            reader.skip(length);
+        } else {
+            value = window & 0xFFFF;
+            reader.skip(RICE_ESCAPE_QUOTIENT + 16);
+        }
+        deltas[i] = riceUnZigZag(value);
+    }
+    return !reader.overrun();
+}
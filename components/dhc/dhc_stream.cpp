@@ -0,0 +1,353 @@
+#include "dhc_stream.h"
+#include <string.h>
+#include "esp_log.h"
+#include "dhc_predictor.h"
+#include <algorithm>
+
+#define TAG "DHC_STREAM"
+
+// Drop consumed bytes from the front of a queue once they dominate it
+template <typename T>
+static void compact(std::vector<T>& queue, size_t& head) {
+    if (head > 0 && head >= queue.size() / 2) {
+        queue.erase(queue.begin(), queue.begin() + head);
+        head = 0;
+    }
+}
+
+DHCStreamEncoder::DHCStreamEncoder(size_t block_samples) : blockSamples(0) {
+    set_block_samples(block_samples);
+}
+
+bool DHCStreamEncoder::set_block_samples(size_t block_samples) {
+    if (block_samples == 0 || block_samples > DHC::MAX_BLOCK_SAMPLES) {
+        ESP_LOGE(TAG, "Invalid block size: %u", (unsigned)block_samples);
+        return false;
+    }
+    blockSamples = block_samples;
+    if (buffer.size() < blockSamples * codec.channels() * sampleBytes) {
+        buffer.resize(blockSamples * codec.channels() * sampleBytes);
+    }
+    // Buffered samples that no longer fit go out as a full block
+    if (buffered >= blockSamples * codec.channels()) {
+        return encodeBuffered();
+    }
+    return true;
+}
+
+bool DHCStreamEncoder::set_channels(unsigned channels) {
+    if (headerWritten || buffered > 0 || partialBytes > 0) {
+        ESP_LOGE(TAG, "Channel count must be set before the first sample");
+        return false;
+    }
+    if (!codec.set_channels(channels)) {
+        return false;
+    }
+    if (buffer.size() < blockSamples * channels * sampleBytes) {
+        buffer.resize(blockSamples * channels * sampleBytes);
+    }
+    return true;
+}
+
+bool DHCStreamEncoder::set_sample_format(uint8_t format) {
+    if (headerWritten || buffered > 0 || partialBytes > 0) {
+        ESP_LOGE(TAG, "Sample format must be set before the first sample");
+        return false;
+    }
+    if (dhcSampleBits(format) % 8 != 0) {
+        ESP_LOGE(TAG, "Streams take whole-byte samples");
+        return false;
+    }
+    if (!codec.set_sample_format(format)) {
+        return false;
+    }
+    sampleBytes = dhcSampleBits(format) / 8;
+    if (buffer.size() < blockSamples * codec.channels() * sampleBytes) {
+        buffer.resize(blockSamples * codec.channels() * sampleBytes);
+    }
+    return true;
+}
+
+bool DHCStreamEncoder::encodeBuffered() {
+    const unsigned channels = codec.channels();
+    const unsigned planes = codec.samplePlanes;
+    if (!headerWritten) {
+        const bool formatted = codec.sample_format() != DHC::SAMPLE_DEFAULT;
+        uint16_t magic = formatted ? STREAM_FORMAT_MAGIC : channels > 1 ? STREAM_CHANNELS_MAGIC : STREAM_MAGIC;
+        queue.push_back(static_cast<uint8_t>(magic >> 8));
+        queue.push_back(static_cast<uint8_t>(magic & 0xFF));
+        if (formatted || channels > 1) {
+            queue.push_back(static_cast<uint8_t>(channels));
+        }
+        if (formatted) {
+            queue.push_back(codec.sample_format());
+        }
+        headerWritten = true;
+    }
+    // Whole frames only, one block per lane for every range of frames
+    const size_t frames = buffered / channels;
+    size_t done = 0;
+    while (done < frames) {
+        size_t count = std::min(blockSamples, frames - done);
+        for (unsigned lane = 0; lane < channels * planes; lane++) {
+            const uint8_t* samples = buffer.data() + (done * channels + lane / planes) * sampleBytes;
+            if (!codec.appendBlock(samples, count, channels, previous[lane], lane, queue)) {
+                return false;
+            }
+            previous[lane] = codec.sampleCoders[lane % planes]->load(samples, (count - 1) * channels);
+        }
+        done += count;
+    }
+    // An incomplete frame waits for the rest of its samples
+    size_t rest = buffered - frames * channels;
+    memmove(buffer.data(), buffer.data() + frames * channels * sampleBytes, rest * sampleBytes);
+    buffered = rest;
+    return true;
+}
+
+bool DHCStreamEncoder::bufferSamples(const uint8_t* data, size_t count) {
+    const size_t capacity = blockSamples * codec.channels();
+    while (count > 0) {
+        size_t take = std::min(count, capacity - buffered);
+        memcpy(buffer.data() + buffered * sampleBytes, data, take * sampleBytes);
+        buffered += take;
+        data += take * sampleBytes;
+        count -= take;
+        if (buffered == capacity && !encodeBuffered()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool DHCStreamEncoder::push(const uint16_t* samples, size_t count) {
+    if (!samples && count > 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    if (codec.sample_format() != DHC::SAMPLE_DEFAULT) {
+        ESP_LOGE(TAG, "push() takes 16-bit samples, use push_bytes()");
+        return false;
+    }
+    return bufferSamples(reinterpret_cast<const uint8_t*>(samples), count);
+}
+
+bool DHCStreamEncoder::push_bytes(const uint8_t* data, size_t size) {
+    if (!data && size > 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    // Complete a sample split across calls
+    if (partialBytes > 0) {
+        size_t take = std::min(size, sampleBytes - partialBytes);
+        memcpy(partial + partialBytes, data, take);
+        partialBytes += take;
+        data += take;
+        size -= take;
+        if (partialBytes < sampleBytes) return true;
+        partialBytes = 0;
+        if (!bufferSamples(partial, 1)) return false;
+    }
+    if (!bufferSamples(data, size / sampleBytes)) {
+        return false;
+    }
+    partialBytes = size % sampleBytes;
+    memcpy(partial, data + size - partialBytes, partialBytes);
+    return true;
+}
+
+size_t DHCStreamEncoder::pull(uint8_t* output, size_t capacity) {
+    size_t count = std::min(capacity, pending());
+    if (count > 0) {
+        memcpy(output, queue.data() + queueHead, count);
+        queueHead += count;
+    }
+    if (queueHead == queue.size()) {
+        queue.clear();
+        queueHead = 0;
+    } else {
+        compact(queue, queueHead);
+    }
+    return count;
+}
+
+bool DHCStreamEncoder::flush(bool end_of_input) {
+    // A partial sample stays for the next push_bytes(), as does an incomplete
+    // frame
+    if (buffered >= codec.channels() && !encodeBuffered()) {
+        return false;
+    }
+    // At the end of input either one would be lost
+    if (end_of_input && (partialBytes > 0 || buffered > 0)) {
+        ESP_LOGE(TAG, "Input ends inside a sample or frame: %u bytes left over",
+                 (unsigned)(partialBytes + buffered * sampleBytes));
+        return false;
+    }
+    return true;
+}
+
+void DHCStreamEncoder::reset() {
+    buffered = 0;
+    memset(previous, 0, sizeof(previous));
+    headerWritten = false;
+    partialBytes = 0;
+    queue.clear();
+    queueHead = 0;
+    codec.resetTableReuse();
+}
+
+DHCStreamDecoder::DHCStreamDecoder() {
+    useSampleFormat(DHC::SAMPLE_DEFAULT);
+}
+
+bool DHCStreamDecoder::useSampleFormat(uint8_t format) {
+    const DhcSampleCoder* formatCoders[DHC_MAX_SAMPLE_PLANES] = {};
+    for (unsigned plane = 0; plane < dhcSamplePlanes(format); plane++) {
+        formatCoders[plane] = dhcSampleCoder(format, plane);
+    }
+    if (dhcSampleBits(format) % 8 != 0 || !formatCoders[0] || (dhcSamplePlanes(format) > 1 && !formatCoders[1])) {
+        ESP_LOGE(TAG, "Unsupported sample format: 0x%02X", format);
+        return false;
+    }
+    sampleFormat = format;
+    planes = dhcSamplePlanes(format);
+    sampleBytes = dhcSampleBits(format) / 8;
+    memcpy(coders, formatCoders, sizeof(coders));
+    return true;
+}
+
+bool DHCStreamDecoder::push(const uint8_t* data, size_t size) {
+    if (!data && size > 0) {
+        ESP_LOGE(TAG, "Invalid input parameters");
+        return false;
+    }
+    input.insert(input.end(), data, data + size);
+    return decodeAvailable();
+}
+
+bool DHCStreamDecoder::decodeAvailable() {
+    if (!headerSeen) {
+        if (input.size() - inputHead < 2) return true;
+        uint16_t magic = static_cast<uint16_t>((input[inputHead] << 8) | input[inputHead + 1]);
+        if (magic == DHCStreamEncoder::STREAM_CHANNELS_MAGIC || magic == DHCStreamEncoder::STREAM_FORMAT_MAGIC) {
+            size_t extra = magic == DHCStreamEncoder::STREAM_FORMAT_MAGIC ? 2 : 1;
+            if (input.size() - inputHead < 2 + extra) return true;
+            channels = input[inputHead + 2];
+            if (channels == 0 || channels > DHC::MAX_CHANNELS) {
+                ESP_LOGE(TAG, "Invalid channel count: %u", channels);
+                return false;
+            }
+            if (extra == 2 && !useSampleFormat(input[inputHead + 3])) {
+                return false;
+            }
+            inputHead += extra;
+        } else if (magic != DHCStreamEncoder::STREAM_MAGIC) {
+            ESP_LOGE(TAG, "Invalid magic number");
+            return false;
+        }
+        inputHead += 2;
+        headerSeen = true;
+    }
+
+    // Decode every block that has fully arrived
+    while (true) {
+        size_t available = input.size() - inputHead;
+        size_t length;
+        if (!codec.blockLength(input.data() + inputHead, available, &length)) {
+            ESP_LOGE(TAG, "Invalid block header");
+            return false;
+        }
+        if (length > available) break;
+
+        // A single lane is decoded straight onto the end of the queue;
+        // otherwise, and for the sink, every lane goes to its interleaved
+        // place in frames. Whether the range goes to the sink is settled by
+        // its first block.
+        const uint8_t* header = input.data() + inputHead;
+        size_t count = (static_cast<size_t>(header[0]) << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        const unsigned lanes = channels * planes;
+        const unsigned channel = nextLane / planes;
+        if (nextLane == 0) {
+            framesToSink = sink != nullptr;
+            if (framesToSink && planes > 1) {
+                ESP_LOGE(TAG, "%u-bit samples cannot be decoded to a sink", dhcSampleBits(sampleFormat));
+                return false;
+            }
+        }
+        // The sink takes 16-bit values, which the residuals of narrower
+        // samples decode to directly
+        const DhcSampleCoder* coder = framesToSink ? dhcSampleCoder(DHC::SAMPLE_DEFAULT, 0) : coders[nextLane % planes];
+        const size_t frameBytes = channels * (framesToSink ? sizeof(uint16_t) : sampleBytes);
+        size_t queued = decoded.size();
+        uint8_t* target;
+        if (lanes == 1 && !framesToSink) {
+            decoded.resize(queued + count * sampleBytes);
+            target = decoded.data() + queued;
+        } else if (nextLane == 0) {
+            frames.resize(count * frameBytes);
+            target = frames.data();
+        } else if (count * frameBytes != frames.size()) {
+            ESP_LOGE(TAG, "Channel blocks differ in length");
+            return false;
+        } else {
+            target = frames.data();
+        }
+        if (!codec.decodeBlock(header, length, previous[nextLane], nextLane, target, channels, coder, channel)) {
+            decoded.resize(queued);
+            return false;
+        }
+        previous[nextLane] = coder->load(target, channel + (count - 1) * channels);
+        inputHead += length;
+
+        // Frames are complete once the last lane's block is in
+        if (++nextLane < lanes) continue;
+        nextLane = 0;
+        if (framesToSink) {
+            if (!sink(reinterpret_cast<const uint16_t*>(frames.data()), frames.size() / sizeof(uint16_t),
+                      sinkContext)) {
+                ESP_LOGE(TAG, "Decoding stopped by the sink");
+                return false;
+            }
+        } else if (lanes > 1) {
+            decoded.insert(decoded.end(), frames.begin(), frames.end());
+        }
+    }
+    compact(input, inputHead);
+    return true;
+}
+
+size_t DHCStreamDecoder::pull(uint16_t* samples, size_t capacity) {
+    if (sampleFormat != DHC::SAMPLE_DEFAULT) {
+        ESP_LOGE(TAG, "pull() gives 16-bit samples, use pull_bytes()");
+        return 0;
+    }
+    return pull_bytes(reinterpret_cast<uint8_t*>(samples), capacity * sizeof(uint16_t)) / sizeof(uint16_t);
+}
+
+size_t DHCStreamDecoder::pull_bytes(uint8_t* output, size_t capacity) {
+    size_t count = std::min(capacity / sampleBytes, pending()) * sampleBytes;
+    if (count > 0) {
+        memcpy(output, decoded.data() + decodedHead, count);
+        decodedHead += count;
+    }
+    if (decodedHead == decoded.size()) {
+        decoded.clear();
+        decodedHead = 0;
+    } else {
+        compact(decoded, decodedHead);
+    }
+    return count;
+}
+
+void DHCStreamDecoder::reset() {
+    input.clear();
+    inputHead = 0;
+    headerSeen = false;
+    channels = 1;
+    useSampleFormat(DHC::SAMPLE_DEFAULT);
+    nextLane = 0;
+    memset(previous, 0, sizeof(previous));
+    decoded.clear();
+    decodedHead = 0;
+    codec.resetTableReuse();
+}
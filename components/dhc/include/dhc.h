@@ -1,46 +1,363 @@
 #pragma once
 
 #include <cstdint>
-#include <memory>
-#include <string>
-#include <unordered_map>
+#include <cstdio>
 #include <vector>
 
-// Huffman tree node
-struct HuffmanNode {
-    int16_t value;
-    size_t frequency;
-    std::shared_ptr<HuffmanNode> left;
-    std::shared_ptr<HuffmanNode> right;
-    
-    HuffmanNode(int16_t val, size_t freq) : value(val), frequency(freq), left(nullptr), right(nullptr) {}
-};
+#include "dhc_huffman.h"
+#include "dhc_samples.h"
+
+class DHCFileReader;
+class DHCFileWriter;
+struct DhcSampleCoder;
 
 class DHC {
+    friend class DHCStreamEncoder;
+    friend class DHCStreamDecoder;
+    friend class DHCParallel;
+    friend class DHCBatchEncoder;
+    friend class DHCBatchDecoder;
+
 public:
     DHC();
     ~DHC();
 
     bool compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size);
+
+    // Zero-heap variant: all scratch memory comes from the caller's workspace,
+    // which must hold at least workspace_size(n) bytes, n being the block size
+    // in samples. Inputs longer than n samples are written as several blocks.
+    bool compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size,
+                  void* workspace, size_t workspace_bytes);
+    static size_t workspace_size(size_t block_samples);
+
+    // Largest output compress() can produce from input_size bytes with the
+    // current channels and sample format, in blocks of at most block_samples
+    // frames (the workspace capacity for the zero-heap variant). Blocks that
+    // no code would shrink are stored, two bytes per sample, so output never
+    // grows past this.
+    size_t compress_bound(size_t input_size, size_t block_samples = MAX_BLOCK_SAMPLES) const;
+
+    // Pretrained code tables (dhc_static_tables.h): with a table selected, blocks
+    // reference it by ID instead of carrying their own, and encoding skips code
+    // construction. 0 selects per-block tables (default).
+    bool set_static_table(uint8_t table_id);
+    uint8_t static_table() const { return staticTableId; }
+    // Registers a table trained with dhc_train --binary, for encoding and decoding
+    bool load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size);
+
+    // Keeps the last code table across the blocks of one compress() call, file or
+    // stream; blocks coded with it are marked "reuse previous table" and carry no
+    // table. A new table is built once the kept one codes a block more than
+    // drift_percent worse than it coded the block it was built for.
+    void set_table_reuse(bool enable, unsigned drift_percent = 10);
+    bool table_reuse() const { return tableReuse; }
+
+    // Entropy coder for blocks without a static table: Huffman with a per-block
+    // table, table-free Rice coding of zig-zag deltas (dhc_rice.h), or per block
+    // whichever of the two is estimated smaller (default).
+    enum Engine : uint8_t { ENGINE_AUTO, ENGINE_HUFFMAN, ENGINE_RICE };
+    void set_engine(Engine engine) { codingEngine = engine; }
+    Engine engine() const { return codingEngine; }
+
+    // Fixed linear predictor of order 0 to 4 (dhc_predictor.h) applied before
+    // entropy coding; order 1 is the plain delta. PREDICTOR_AUTO (default) picks
+    // the order per block from the residual magnitudes.
+    static const unsigned PREDICTOR_AUTO = 0xFF;
+    bool set_predictor(unsigned order);
+    unsigned predictor() const { return predictorSetting; }
+
+    // Interleaved multi-channel samples (channel 0, 1, ..., channels - 1, channel 0,
+    // ...): compress() de-interleaves on the fly and codes every channel as its own
+    // series, with its own deltas and code tables; decompress() re-interleaves. The
+    // input must hold whole frames of one sample per channel. Files are single-channel.
+    static const unsigned MAX_CHANNELS = 16;
+    bool set_channels(unsigned channels);
+    unsigned channels() const { return channelCount; }
+
+    // Raw sample format (dhc_samples.h): bits per sample, 8, 12, 16, 24 or 32,
+    // ORed with SAMPLE_SIGNED and SAMPLE_BIG_ENDIAN; 12-bit samples are packed,
+    // two in three bytes. compress() reads and decompress() writes samples in
+    // place, through loops compiled for each format. Samples wider than 16 bits
+    // are coded as two 16-bit planes, each like a channel of its own. Buffers
+    // and streams record the format; files hold 16-bit little-endian samples.
+    static const uint8_t SAMPLE_SIGNED = DHC_SAMPLE_SIGNED;
+    static const uint8_t SAMPLE_BIG_ENDIAN = DHC_SAMPLE_BIG_ENDIAN;
+    static const uint8_t SAMPLE_DEFAULT = DHC_SAMPLE_DEFAULT;  // 16-bit little-endian
+    bool set_sample_format(uint8_t format);
+    uint8_t sample_format() const { return sampleFormat; }
+
+    // Samples are reconstructed straight into output, interleaved when there
+    // are several channels and in the sample format the input records; the
+    // only scratch memory is one block of residuals. A file written by
+    // compress_file decodes here too once it is in memory.
     bool decompress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size);
+    // Hands the decoded samples to sink one block (one block per channel,
+    // interleaved) at a time instead, so memory does not grow with the output.
+    // Spans are as long as the blocks, i.e. the block size used to compress
+    // except for the last one. The span is only valid during the call; the
+    // sink returns false to stop decoding, and decompress() then fails.
+    // Samples of up to 16 bits reach the sink as 16-bit values, sign- or
+    // zero-extended; wider formats cannot be decoded to a sink.
+    typedef bool (*SampleSink)(const uint16_t* samples, size_t count, void* context);
+    bool decompress(const uint8_t* input, size_t input_size, SampleSink sink, void* context);
     bool compress_file(const char* input_file, const char* output_file);
     bool decompress_file(const char* input_file, const char* output_file);
+    // Decodes samples [first_sample, first_sample + sample_count) of a file
+    // written by compress_file, reading only the blocks that hold them
+    bool decompress_range(const char* input_file, size_t first_sample, size_t sample_count, uint8_t* output,
+                          size_t* output_size);
+
+    // Read-only inspection of compressed data, for tools; nothing is decoded.
+    // inspect() reads the header of a buffer, stream, file or batch and gives
+    // the byte range its blocks fill; a file's blocks end at its seek index.
+    // A batch's range is empty: its blocks are found record by record with
+    // DHCBatchDecoder::record_blocks().
+    enum Container : uint8_t { CONTAINER_BUFFER, CONTAINER_STREAM, CONTAINER_FILE, CONTAINER_BATCH };
+    struct ContainerInfo {
+        Container container;
+        unsigned channels;
+        uint8_t sampleFormat;
+        size_t blocksBegin;  // offset of the first block
+        size_t blocksEnd;    // offset after the last block
+    };
+    static bool inspect(const uint8_t* input, size_t input_size, ContainerInfo* info);
+
+    // Block types, the low nibble of a block header's type byte
+    static const uint8_t BLOCK_DYNAMIC = 0;     // followed by the block's code table
+    static const uint8_t BLOCK_STATIC = 1;      // followed by a static table ID
+    static const uint8_t BLOCK_REUSE = 2;       // coded with the previous block's table
+    static const uint8_t BLOCK_RICE = 3;        // followed by the Rice parameter
+    static const uint8_t BLOCK_STORED = 4;      // residuals as 16-bit little-endian values
+    static const unsigned BLOCK_TYPES = 5;
+    struct BlockInfo {
+        uint32_t samples;     // of the block's lane
+        uint8_t type;         // BLOCK_DYNAMIC to BLOCK_STORED
+        uint8_t predictor;    // order, 0 to 4
+        size_t tableBytes;    // code table, static table ID or Rice parameter
+        size_t payloadBytes;
+        size_t length;        // whole block, header included
+    };
+    // Describes the block at block; false unless the available bytes hold all
+    // of a valid block
+    bool block_info(const uint8_t* block, size_t available, BlockInfo* info) const;
+
+    // File functions read and write whole buffers of this many bytes
+    // (dhc_file_io.h). With background_io a task reads ahead or writes behind
+    // into a second buffer, so flash access overlaps coding.
+    static const size_t FILE_BUFFER_SIZE = 16384;
+    bool set_file_buffer(size_t bytes, bool background_io = false);
+
+    // Opt-in counters, summed over all calls since reset_stats(). Built only
+    // with DHC_STATS (dhc_stats.h); otherwise get_stats() returns zeros and no
+    // counting code is compiled in. Times are CPU cycles on the device and
+    // nanoseconds on the host, spent in the caller's thread.
+    struct Stats {
+        uint64_t deltaTime;      // predictor choice and residuals
+        uint64_t histogramTime;  // symbol classification and histogram
+        uint64_t treeTime;       // Huffman code construction, reuse check, Rice parameter
+        uint64_t encodeTime;     // block headers and code tables
+        uint64_t packTime;       // payload bit-packing
+        uint64_t decodeTime;     // whole blocks, table to samples
+        uint64_t ioTime;         // file reads and writes, or waits for the I/O task
+        uint64_t bytesIn;        // sample bytes encoded plus block bytes decoded
+        uint64_t bytesOut;       // block bytes encoded plus sample bytes decoded
+        uint32_t blocks;         // blocks encoded or decoded
+        uint32_t tableBytes;     // code tables written, in bytes
+        uint8_t longestCode;     // longest Huffman code written
+        size_t heapHighWater;    // most heap held at once by codec and file buffers
+    };
+#if DHC_STATS
+    static const bool STATS_ENABLED = true;
+    Stats get_stats() const { return stats; }
+    void reset_stats() { stats = Stats(); }
+#else
+    static const bool STATS_ENABLED = false;
+    Stats get_stats() const { return Stats(); }
+    void reset_stats() {}
+#endif
 
     // New methods for chunked processing
     static const size_t CHUNK_SIZE = 4096;  // Process 4KB at a time
+    static const size_t MAX_BLOCK_SAMPLES = 65535;  // Longest block, in samples
 
 private:
     static const uint16_t MAGIC = 0x4448;  // "DH" in ASCII as magic number
-    std::vector<int16_t> lastDeltaValues;
-    std::unordered_map<int16_t, std::string> lastHuffmanCodes;
-
-    std::vector<int16_t> computeDeltaValues(const std::vector<uint16_t>& data);
-    std::vector<uint16_t> reconstructFromDelta(const std::vector<int16_t>& deltaValues);
-    std::unordered_map<int16_t, std::string> buildHuffmanCodes(const std::vector<int16_t>& deltaValues);
-    void generateCodes(const std::shared_ptr<HuffmanNode>& node, std::string code,
-                      std::unordered_map<int16_t, std::string>& codes);
-    
+    static const uint16_t CHANNELS_MAGIC = 0x444D;  // "DM": channel count byte, then blocks
+    static const uint16_t FORMAT_MAGIC = 0x4454;    // "DT": channel count and sample format bytes, then blocks
+    // Files: magic, original size, blocks, seek index, trailer
+    static const uint16_t FILE_MAGIC = 0x4446;   // "DF"
+    static const uint16_t INDEX_MAGIC = 0x4458;  // "DX", ends the trailer
+    static const size_t FILE_HEADER_SIZE = 6;    // magic + original size
+    static const size_t INDEX_ENTRY_SIZE = 12;   // block offset + first sample + table block offset
+    static const size_t FILE_TRAILER_SIZE = 10;  // block count + index offset + index magic
+    static const size_t BLOCK_HEADER_SIZE = 9;  // sample count + payload byte count + block type
+    static const uint8_t BLOCK_TYPE_MASK = 0x0F;  // block type byte: predictor order in the high nibble
+    static const unsigned PREDICTOR_SHIFT = 4;
+    static uint8_t blockTypeByte(uint8_t blockType, uint8_t predictor) {
+        return static_cast<uint8_t>(blockType | (predictor << PREDICTOR_SHIFT));
+    }
+    static const unsigned MAX_ENCODE_LENGTH = 32;  // longest code BitWriter accepts
+    static const unsigned CODE_LENGTH_LIMIT = 15;  // longest code in a block's own table
+    HuffmanTable blockTable;
+    std::vector<int16_t> blockDeltas;
+    std::vector<uint16_t> decodedSamples;
+
+    // Scratch arrays for encoding one block, carved from a workspace buffer
+    struct Workspace;
+    std::vector<uint8_t> ownWorkspace;
+    std::vector<uint8_t> blockBuffer;
+
+    // Static table ready for use, codes indexed by alphabet symbol
+    struct StaticCoder {
+        uint8_t id;
+        HuffmanTable table;
+        HuffmanDecoder decoder;
+        HuffmanCode codes[DHC_ALPHABET_SIZE];
+    };
+    std::vector<StaticCoder> staticCoders;
+    uint8_t staticTableId = 0;
+
+    const StaticCoder* findStaticCoder(uint8_t id);
+    bool addStaticCoder(uint8_t id, const HuffmanTable& table);
+    size_t writeStaticBlock(const Workspace& ws, uint8_t* output, size_t capacity) const;
+
+    Engine codingEngine = ENGINE_AUTO;
+    size_t writeRiceBlock(const Workspace& ws, uint8_t* output, size_t capacity) const;
+    void useRice(Workspace& ws, unsigned k);
+
+    // Fallback for blocks no code would shrink: the residuals copied as they are
+    static size_t storedBlockSize(size_t samples) { return BLOCK_HEADER_SIZE + samples * sizeof(int16_t); }
+    size_t writeStoredBlock(const Workspace& ws, uint8_t* output, size_t capacity) const;
+    void useStored(Workspace& ws);
+    // Container magic (and channel count and sample format) before the blocks
+    size_t containerHeaderSize() const;
+    // Blocks of at most block_samples frames for every lane, all stored
+    static size_t blocksBound(size_t frames, unsigned lanes, size_t block_samples);
+
+    unsigned channelCount = 1;
+    unsigned predictorSetting = PREDICTOR_AUTO;
+
+    // Every plane of every channel is a lane, coded as a series of its own:
+    // lane = channel * planes + plane. Kept tables and decoders are per lane.
+    static const unsigned MAX_LANES = MAX_CHANNELS * DHC_MAX_SAMPLE_PLANES;
+    uint8_t sampleFormat = SAMPLE_DEFAULT;
+    unsigned samplePlanes = 1;
+    const DhcSampleCoder* sampleCoders[DHC_MAX_SAMPLE_PLANES] = {};
+    unsigned lanes() const { return channelCount * samplePlanes; }
+    size_t fileBufferSize = FILE_BUFFER_SIZE;
+    bool fileBackgroundIo = false;
+
+#if DHC_STATS
+    // Also counted by the const block writers
+    mutable Stats stats = {};
+    // Notes the heap held by the scratch buffers plus extra bytes elsewhere
+    void noteHeap(size_t extra);
+    void noteBlock(const Workspace& ws, size_t block_size);
+#endif
+
+    // Table reuse: every channel keeps the last table sent for it. Kept tables
+    // are allocated when reuse or the channel count is set, not while encoding.
+    bool tableReuse = false;
+    unsigned reuseDriftPercent = 10;
+    struct KeptTable {
+        HuffmanCode codes[DHC_ALPHABET_SIZE];
+        uint64_t bitsPerSample;  // cost on its own block, in 1/256 bits
+        bool valid;
+    };
+    std::vector<KeptTable> keptTables;
+    // Decoder of the last table received for each channel
+    struct ChannelDecoder {
+        HuffmanDecoder decoder;
+        bool ready = false;
+    };
+    std::vector<ChannelDecoder> channelDecoders;
+    void resetTableReuse();
+    // Makes the table of a dynamic block (header and table, no payload) the
+    // channel's previous table, as if the block had been decoded
+    bool loadBlockTable(const uint8_t* input, size_t size, unsigned channel);
+    // Makes a bare code table the previous table of the first lanes; returns
+    // its size, 0 if it is invalid
+    size_t loadSharedTable(const uint8_t* input, size_t size, unsigned lanes);
+
+    // Batch records (dhc_batch.h): when set, blocks coded with Huffman codes
+    // use these, which cover every symbol of the batch, and are written as
+    // reuse blocks, unless a table of their own comes out smaller
+    const HuffmanCode* sharedCodes = nullptr;
+    void chooseSharedCodes(Workspace& ws);
+    // Decoding them, such a table is used for its block only and the lanes
+    // keep the shared one
+    bool keepSharedTable = false;
+    HuffmanDecoder blockDecoder;
+    // Adds the symbols of a record's blocks, predicted as they will be coded
+    void addRecordHistogram(const uint8_t* input, size_t frames, uint32_t* histogram);
+    // Codes for every symbol counted, and their table; returns its size, 0 if
+    // it does not fit
+    size_t writeSharedTable(const uint32_t* histogram, HuffmanCode* codes, uint8_t* output, size_t capacity);
+    size_t compressRecord(const uint8_t* input, size_t frames, uint8_t* output, size_t capacity);
+
+    static size_t layoutWorkspace(uintptr_t base, size_t block_samples, Workspace* ws);
+    // Largest block size whose workspace fits; workspace_size(n) gives n
+    static size_t workspaceCapacity(size_t workspace_bytes);
+    // Samples are every stride-th one from index first of input or output
+    static void computeDeltaValues(const DhcSampleCoder& samples, const uint8_t* input, size_t first, size_t count,
+                                   size_t stride, uint16_t previous, unsigned order, int16_t* deltaValues);
+    static void reconstructFromDelta(const DhcSampleCoder& samples, const int16_t* deltaValues, size_t count,
+                                     uint16_t previous, unsigned order, uint8_t* output, size_t first, size_t stride);
+    void classifyDeltas(Workspace& ws);
+    void buildHuffmanCodes(Workspace& ws);
+    bool reuseHuffmanCodes(Workspace& ws, const KeptTable& kept);
+    void prepareHuffmanCodes(Workspace& ws);
+
+    // Block serialization: [sample count][payload bytes][code table][payload]
+    size_t encodedBlockSize(const Workspace& ws) const;
+    // Table of a dynamic block: 1 + 2 * maxLength + distinct bytes
+    size_t writeCodeTable(const Workspace& ws, uint8_t* output) const;
+    size_t writeBlock(const Workspace& ws, uint8_t* output, size_t capacity) const;
+    // Blocks of one lane: samples are every stride-th one from index first of
+    // input, in the sample format set, and reuse refers to the lane's own kept
+    // table
+    void predictBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                      Workspace& ws);
+    size_t planBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                     Workspace& ws);
+    size_t writePlannedBlock(const Workspace& ws, uint8_t* output, size_t capacity);
+    size_t compressBlock(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                         unsigned lane, uint8_t* output, size_t capacity, Workspace& ws);
+    // Blocks of every lane for each range of block capacity frames, as in a buffer
+    size_t compressFrames(const uint8_t* input, size_t frames, uint8_t* output, size_t capacity, Workspace& ws);
+    bool appendBlock(const uint8_t* input, size_t count, size_t stride, uint16_t previous, unsigned lane,
+                     std::vector<uint8_t>& out);
+    bool blockLength(const uint8_t* input, size_t available, size_t* length) const;
+    // Shared by both decompress() variants: into output when sink is null
+    bool decodeContainer(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size,
+                         SampleSink sink, void* context);
+    // The blocks after a container header, decoded with the lanes' current tables
+    bool decodeBlocks(const uint8_t* input, size_t input_size, unsigned channels, uint8_t format, uint8_t* output,
+                      size_t* output_size, SampleSink sink, void* context);
+    // 16-bit samples, unless a coder for another format and plane is given;
+    // the block fills every stride-th sample from index first of output
+    bool decodeBlock(const uint8_t* input, size_t size, uint16_t previous, unsigned lane,
+                     std::vector<uint16_t>& samples);
+    bool decodeBlock(const uint8_t* input, size_t size, uint16_t previous, unsigned lane, uint8_t* output,
+                     size_t stride, const DhcSampleCoder* samples = nullptr, size_t first = 0);
+    size_t readCodeTable(const uint8_t* input, size_t input_size, HuffmanTable& table) const;
+
+    // Seek index entry of one file block. While table reuse keeps a table, a
+    // block that carries none also names the block that does; 0 otherwise.
+    struct IndexEntry {
+        uint32_t offset;
+        uint32_t firstSample;
+        uint32_t tableOffset;
+    };
+    static void appendIndexEntry(std::vector<uint8_t>& index, const IndexEntry& entry);
+    static bool writeFileIndex(DHCFileWriter& writer, const std::vector<uint8_t>& index, uint32_t index_offset);
+    // Reads the trailer and index of an open file and checks them against the
+    // header's original size; blocks end where the index starts
+    static bool readFileIndex(FILE* in_file, std::vector<IndexEntry>& entries, uint32_t* index_offset);
+    bool readFileBlock(DHCFileReader& reader, size_t* length);
+
     // Helper methods for chunked processing
-    bool process_file_chunk(FILE* in_file, FILE* out_file, uint8_t* buffer, size_t buffer_size);
-    bool process_compressed_chunk(FILE* in_file, FILE* out_file, uint8_t* buffer, size_t buffer_size);
+    bool process_file_chunk(DHCFileWriter& writer, const uint8_t* buffer, size_t buffer_size);
+    bool process_compressed_chunk(DHCFileReader& reader, DHCFileWriter& writer);
 }; 
\ No newline at end of file
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Symbol alphabet for deltas, shared by dynamic and static code tables.
+// Small deltas are symbols of their own; larger ones are coded as a
+// magnitude class followed by raw extra bits, like DEFLATE length codes:
+//
+//   symbol          deltas                         extra bits
+//   0 .. 127        -64 .. 63                      0
+//   128 + k         2^(k+6) .. 2^(k+7) - 1         k + 6        (k = 0..8)
+//   137 + k         -2^(k+7) .. -2^(k+6) - 1       k + 6        (k = 0..8)
+//
+// A delta is base + extra, extra being the raw bits, so every class decodes
+// with one addition. Any table therefore has at most DHC_ALPHABET_SIZE
+// entries, whatever the signal.
+static const int DHC_DIRECT_LIMIT = 64;
+static const unsigned DHC_CLASS_COUNT = 9;
+static const unsigned DHC_ALPHABET_SIZE = 2 * DHC_DIRECT_LIMIT + 2 * DHC_CLASS_COUNT;
+static const unsigned DHC_MAX_EXTRA_BITS = 14;
+
+struct DhcSymbolInfo {
+    int16_t base;
+    uint8_t extraBits;
+};
+
+struct DhcAlphabet {
+    DhcSymbolInfo symbols[DHC_ALPHABET_SIZE];
+};
+
+constexpr DhcAlphabet dhcMakeAlphabet() {
+    DhcAlphabet alphabet{};
+    for (int s = 0; s < 2 * DHC_DIRECT_LIMIT; s++) {
+        alphabet.symbols[s] = DhcSymbolInfo{static_cast<int16_t>(s - DHC_DIRECT_LIMIT), 0};
+    }
+    for (unsigned k = 0; k < DHC_CLASS_COUNT; k++) {
+        alphabet.symbols[2 * DHC_DIRECT_LIMIT + k] =
+            DhcSymbolInfo{static_cast<int16_t>(1 << (k + 6)), static_cast<uint8_t>(k + 6)};
+        alphabet.symbols[2 * DHC_DIRECT_LIMIT + DHC_CLASS_COUNT + k] =
+            DhcSymbolInfo{static_cast<int16_t>(-(1 << (k + 7))), static_cast<uint8_t>(k + 6)};
+    }
+    return alphabet;
+}
+
+inline constexpr DhcAlphabet dhcAlphabet = dhcMakeAlphabet();
+
+// Symbol of a delta
+inline uint8_t dhcDeltaSymbol(int16_t delta) {
+    if (delta >= -DHC_DIRECT_LIMIT && delta < DHC_DIRECT_LIMIT) {
+        return static_cast<uint8_t>(delta + DHC_DIRECT_LIMIT);
+    }
+    // Class by bit length: 64..127 and -128..-65 are class 0
+    uint32_t magnitude = delta > 0 ? static_cast<uint32_t>(delta) : static_cast<uint32_t>(-(delta + 1));
+    unsigned k = (31 - __builtin_clz(magnitude)) - 6;
+    return static_cast<uint8_t>(2 * DHC_DIRECT_LIMIT + (delta > 0 ? 0 : DHC_CLASS_COUNT) + k);
+}
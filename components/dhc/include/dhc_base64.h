@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dhc_stream.h"
+
+// Decodes base64 text in one piece, by the rules of DHCBase64Pipeline::push():
+// whitespace is skipped, '=' padding ends the input, and other characters
+// outside the alphabet are an error
+bool dhcBase64Decode(const char* text, size_t length, std::vector<uint8_t>& output);
+
+// Base64 in, compressed base64 out, in one streaming pass. Text is pushed in
+// fragments of any length, not only multiples of 4; line breaks and other
+// whitespace are skipped. Decoded bytes go straight into a DHCStreamEncoder as
+// raw little-endian samples, and the compressed stream is base64 encoded as it
+// is produced and handed to the output callback a piece at a time. Memory use
+// is the encoder's block plus small fixed buffers, however long the input.
+//
+// The output decodes to a DHC stream ("DS"), see DHCStreamDecoder.
+class DHCBase64Pipeline {
+public:
+    // Receives each piece of base64 output; the text is not NUL-terminated
+    typedef void (*OutputCallback)(const char* text, size_t length, void* context);
+    static const size_t OUTPUT_CHUNK = 256;  // characters per callback, except the last
+
+    explicit DHCBase64Pipeline(OutputCallback output, void* context = nullptr,
+                               size_t block_samples = DHCStreamEncoder::DEFAULT_BLOCK_SAMPLES);
+
+    // Encoder settings (engine, tables, channels) before the first push
+    DHCStreamEncoder& encoder() { return streamEncoder; }
+
+    // Standard base64 alphabet. '=' padding ends the input; anything after it
+    // other than padding and whitespace is an error.
+    bool push(const char* text, size_t length);
+    // Closes the encoder's short block and emits all complete output. With
+    // end_of_input, an unpadded input tail is decoded and the output is
+    // padded and emitted in full; input that ends inside a sample or frame is
+    // an error. The pipeline must be reset() to be reused.
+    bool flush(bool end_of_input = false);
+    void reset();
+
+    // Decoded input bytes and compressed bytes so far
+    size_t bytes_in() const { return bytesIn; }
+    size_t bytes_out() const { return bytesOut; }
+
+private:
+    DHCStreamEncoder streamEncoder;
+    OutputCallback output;
+    void* context;
+
+    // Input side: sextets of an incomplete quad, and whether padding was seen
+    uint32_t inBits = 0;
+    unsigned inSextets = 0;
+    bool inputEnded = false;
+    size_t bytesIn = 0;
+
+    // Output side: bytes of an incomplete triple and unsent text
+    uint8_t carry[3];
+    unsigned carried = 0;
+    char text[OUTPUT_CHUNK];
+    size_t textLength = 0;
+    size_t bytesOut = 0;
+
+    bool decodeTail(uint8_t* out, size_t* count);
+    bool feed(const uint8_t* data, size_t size);
+    void drainEncoder();
+    void encodeOutput(const uint8_t* data, size_t size);
+    void putTriple(const uint8_t* data, size_t count);
+    void emitText();
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dhc.h"
+
+// One record of a batch: raw samples in the batch's channels and sample format
+struct DHCRecord {
+    const uint8_t* data;
+    size_t size;
+};
+
+// Compresses many small independent records, e.g. one sensor frame or
+// certificate each, into one batch. A single histogram over all records
+// gives one Huffman table, stored once; every record is then coded with it
+// and carries only its block headers and its length, instead of the magic,
+// histogram and table of a compress() call of its own.
+//
+// Records share no samples: each starts a fresh predictor history and any
+// record can be decoded on its own with DHCBatchDecoder. Per block the
+// encoder still falls back to a table of the block's own, Rice coding or
+// stored residuals when those come out smaller than the shared table, and
+// with a static table or the Rice engine set no shared table is built at all.
+//
+// Batch: [magic "DB"][channels][sample format][record count u32]
+//        [shared table, or a single 0 byte][record bytes u32]
+//        [records: blocks as in DHC buffers, one per lane per block range]
+//        [length of every record in bytes, 7 bits per byte, low bits first,
+//         the top bit set on all but the last byte]
+class DHCBatchEncoder {
+public:
+    static const uint16_t BATCH_MAGIC = 0x4442;  // "DB"
+
+    bool compress(const DHCRecord* records, size_t count, uint8_t* output, size_t* output_size);
+    // Largest compress() output for these records, see DHC::compress_bound
+    size_t compress_bound(const DHCRecord* records, size_t count) const;
+
+    // Settings of the codec, see DHC. Table reuse is not offered: the shared
+    // table takes its place.
+    void set_engine(DHC::Engine engine) { codec.set_engine(engine); }
+    bool set_predictor(unsigned order) { return codec.set_predictor(order); }
+    bool set_static_table(uint8_t table_id) { return codec.set_static_table(table_id); }
+    bool load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size) {
+        return codec.load_static_table(table_id, table, table_size);
+    }
+    bool set_channels(unsigned channels) { return codec.set_channels(channels); }
+    bool set_sample_format(uint8_t format) { return codec.set_sample_format(format); }
+    DHC::Stats get_stats() const { return codec.get_stats(); }
+    void reset_stats() { codec.reset_stats(); }
+
+private:
+    size_t recordFrames(const DHCRecord& record) const;
+    size_t writeSharedTable(const DHCRecord* records, size_t count, uint8_t* output, size_t capacity);
+
+    DHC codec;
+    HuffmanCode sharedCodes[DHC_ALPHABET_SIZE];
+    std::vector<uint32_t> recordLengths;
+};
+
+// Decodes single records of a batch. open() reads the header and record
+// lengths and builds the shared table's decoder once; the batch must stay in
+// place while records are decoded from it.
+class DHCBatchDecoder {
+public:
+    bool open(const uint8_t* batch, size_t batch_size);
+    size_t record_count() const { return recordEnds.size(); }
+    uint8_t sample_format() const { return sampleFormat; }
+    // Decoded size of a record in bytes
+    size_t record_size(size_t index) const;
+    bool decompress(size_t index, uint8_t* output, size_t* output_size);
+    // See DHC::SampleSink
+    bool decompress(size_t index, DHC::SampleSink sink, void* context);
+    // Compressed blocks of a record, for inspection with DHC::block_info()
+    bool record_blocks(size_t index, const uint8_t** blocks, size_t* size) const {
+        return findRecord(index, blocks, size);
+    }
+
+    // Built-in tables are found by ID; tables loaded into the encoder must be loaded here too
+    bool load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size) {
+        return codec.load_static_table(table_id, table, table_size);
+    }
+    DHC::Stats get_stats() const { return codec.get_stats(); }
+    void reset_stats() { codec.reset_stats(); }
+
+private:
+    bool findRecord(size_t index, const uint8_t** record, size_t* size) const;
+    bool decodeRecord(size_t index, uint8_t* output, size_t* output_size, DHC::SampleSink sink, void* context);
+
+    DHC codec;
+    const uint8_t* records = nullptr;  // first record
+    std::vector<uint32_t> recordEnds;  // from the first record
+    unsigned channels = 1;
+    uint8_t sampleFormat = DHC::SAMPLE_DEFAULT;
+};
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// MSB-first bit writer. Codes are accumulated in a 64-bit register and
+// stored as whole 32-bit big-endian words; flush() writes the final partial
+// word, zero-padded to a byte boundary. Writes past the capacity are dropped
+// and reported by overflow().
+class BitWriter {
+public:
+    BitWriter(uint8_t* data, size_t capacity)
+        : start(data), next(data), end(data + capacity), bits(0), free(64), overflowed(false) {}
+
+    // Append the low `length` bits of code (length <= 32)
+    void write(uint32_t code, unsigned length) {
+        if (length > free) flushWord();
+        free -= length;
+        bits |= static_cast<uint64_t>(code) << free;
+    }
+
+    // Store pending bits; returns the number of bytes written in total
+    size_t flush() {
+        while (free < 64) {
+            if (next < end) {
+                *next++ = static_cast<uint8_t>(bits >> 56);
+            } else {
+                overflowed = true;
+            }
+            bits <<= 8;
+            free = free + 8 > 64 ? 64 : free + 8;
+        }
+        return next - start;
+    }
+
+    bool overflow() const { return overflowed; }
+
+private:
+    void flushWord() {
+        if (end - next >= 4) {
+            uint32_t word = toBigEndian(static_cast<uint32_t>(bits >> 32));
+            memcpy(next, &word, sizeof(word));
+            next += 4;
+        } else {
+            overflowed = true;
+        }
+        bits <<= 32;
+        free += 32;
+    }
+
+    static uint32_t toBigEndian(uint32_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return word;
+#else
+        return __builtin_bswap32(word);
+#endif
+    }
+
+    uint8_t* start;
+    uint8_t* next;
+    uint8_t* end;
+    uint64_t bits;
+    unsigned free;
+    bool overflowed;
+};
+
+// MSB-first bit reader over a byte buffer. Bits are kept left-aligned in a
+// 64-bit register; after refill() at least 57 bits can be peeked. Reading past
+// the end yields zero bits and is reported by overrun().
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size)
+        : next(data), end(data + size), bits(0), available(0), padding(0) {
+        refill();
+    }
+
+    void refill() {
+        if (available > 56) return;
+        if (end - next >= 8) {
+            // Fast path: load 8 bytes at once, keep whole bytes only
+            uint64_t word;
+            memcpy(&word, next, sizeof(word));
+            bits |= toBigEndian(word) >> available;
+            next += (63 - available) >> 3;
+            available |= 56;
+            return;
+        }
+        while (available <= 56) {
+            uint64_t byte = 0;
+            if (next < end) {
+                byte = *next++;
+            } else {
+                padding += 8;
+            }
+            bits |= byte << (56 - available);
+            available += 8;
+        }
+    }
+
+    // Top n bits (1 <= n <= 57) without consuming them
+    uint64_t peek(unsigned n) const { return bits >> (64 - n); }
+
+    void skip(unsigned n) {
+        bits <<= n;
+        available -= n;
+    }
+
+    uint64_t read(unsigned n) {
+        uint64_t value = peek(n);
+        skip(n);
+        return value;
+    }
+
+    // True once more bits were consumed than the buffer holds
+    bool overrun() const { return padding > available; }
+
+private:
+    static uint64_t toBigEndian(uint64_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return word;
+#else
+        return __builtin_bswap64(word);
+#endif
+    }
+
+    const uint8_t* next;
+    const uint8_t* end;
+    uint64_t bits;
+    unsigned available;
+    unsigned padding;
+};
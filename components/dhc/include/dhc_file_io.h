@@ -0,0 +1,118 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+#include "dhc_stats.h"
+
+#if !defined(ESP_PLATFORM)
+#include <thread>
+#endif
+
+// Buffered file access for the DHC file functions. Data moves through the FILE
+// in whole buffers of buffer_size bytes, since FATFS on SPI flash pays for every
+// call far more than for every byte.
+//
+// With background I/O a task takes over the reads or writes: a reader reads the
+// next buffer ahead while the caller takes bytes from the current one, and a
+// writer writes a full buffer behind while the caller fills the other, so flash
+// access overlaps coding. The task is a FreeRTOS task on the device and a
+// std::thread on the host. The FILE belongs to the reader or writer until it is
+// destroyed (or, for a writer, finished).
+class DHCFileBuffer {
+public:
+    bool failed() const { return ioFailed; }
+#if DHC_STATS
+    // Time the caller spent in reads and writes or waiting for the task, in
+    // DHCStatsTicks, and the heap held by the buffers
+    uint64_t io_time() const { return ioTime; }
+    size_t buffer_bytes() const { return buffers.size() * bufferSize; }
+#endif
+
+protected:
+    DHCFileBuffer(FILE* file, size_t buffer_size, bool background, bool writing);
+    ~DHCFileBuffer();
+    DHCFileBuffer(const DHCFileBuffer&) = delete;
+    DHCFileBuffer& operator=(const DHCFileBuffer&) = delete;
+
+    // Reads up to size bytes into, or writes size bytes from, buffers[index]:
+    // in the task if there is one, at once otherwise. One I/O at a time.
+    void startIo(unsigned index, size_t size);
+    // Waits for the I/O started last; bytes moved
+    size_t finishIo();
+    bool ioPending() const { return pending; }
+    unsigned bufferCount() const { return static_cast<unsigned>(buffers.size()); }
+
+    FILE* file;
+    size_t bufferSize;
+    std::vector<std::vector<uint8_t>> buffers;  // two with background I/O, else one
+    bool ioFailed = false;
+#if DHC_STATS
+    uint64_t ioTime = 0;
+#endif
+
+private:
+    enum IoState : uint8_t { IO_IDLE, IO_QUEUED, IO_DONE };
+    bool writing;
+    bool pending = false;  // started and not yet finished
+    unsigned ioIndex = 0;
+    size_t ioSize = 0;
+    size_t ioResult = 0;
+    bool ioOk = true;
+
+    // Background task state
+    bool background;
+    IoState state = IO_IDLE;
+    bool stopping = false;
+    bool running = false;
+    std::mutex lock;
+    std::condition_variable changed;
+#if !defined(ESP_PLATFORM)
+    std::thread thread;
+#endif
+
+    size_t transfer(unsigned index, size_t size, bool* ok);
+    static void taskEntry(void* context);
+    void taskLoop();
+};
+
+class DHCFileReader : public DHCFileBuffer {
+public:
+    DHCFileReader(FILE* file, size_t buffer_size, bool background = false);
+
+    // Copies up to size bytes; fewer only at the end of the file or on an error
+    size_t read(uint8_t* data, size_t size);
+
+private:
+    unsigned current = 0;  // buffer being consumed
+    unsigned ahead = 0;    // buffer being read
+    size_t available = 0;
+    size_t position = 0;
+    bool atEnd = false;
+
+    bool refill();
+};
+
+class DHCFileWriter : public DHCFileBuffer {
+public:
+    DHCFileWriter(FILE* file, size_t buffer_size, bool background = false);
+
+    bool write(const uint8_t* data, size_t size);
+    // Room for size bytes in the buffer, to be filled in place and then
+    // committed, which saves a copy; null if size exceeds the buffer
+    uint8_t* reserve(size_t size);
+    bool commit(size_t size);
+    // Writes out what is buffered and waits for the task; false if any write
+    // failed. Without it, buffered bytes are dropped.
+    bool finish();
+
+private:
+    unsigned current = 0;  // buffer being filled
+    size_t used = 0;
+
+    void flushCurrent();
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dhc_alphabet.h"
+#include "dhc_bitstream.h"
+
+// Canonical Huffman code description as stored in each block header:
+// lengthCounts[len] is the number of codes of length len (index 0 unused),
+// symbols lists the coded alphabet symbols (dhc_alphabet.h) sorted by
+// (code length, symbol).
+struct HuffmanTable {
+    std::vector<uint16_t> lengthCounts;
+    std::vector<uint8_t> symbols;
+
+    uint8_t maxLength() const { return lengthCounts.empty() ? 0 : static_cast<uint8_t>(lengthCounts.size() - 1); }
+};
+
+// Code word of one symbol, right-aligned in `code`
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t length;
+};
+
+// Table-driven canonical Huffman decoder for deltas. One probe of the lookup
+// window (LOOKUP_BITS bits, fewer when all codes are shorter) resolves one
+// symbol, or two when both codes fit in the window and the first has no extra
+// bits; longer codes fall back to a canonical first-code search. The extra
+// bits of a magnitude class follow its code.
+class HuffmanDecoder {
+public:
+    static const unsigned LOOKUP_BITS = 10;
+    static const unsigned MAX_CODE_LENGTH = 57 - DHC_MAX_EXTRA_BITS;  // code plus extra bits in one refill
+
+    bool build(const HuffmanTable& table);
+    bool decode(BitReader& reader, int16_t* output, size_t count) const;
+
+private:
+    struct Entry {
+        int16_t bases[2];     // delta, or class base of the last symbol
+        uint8_t firstLength;  // bits of the first code, 0 if the window holds no full code
+        uint8_t totalLength;  // bits of both codes when count == 2
+        uint8_t count;
+        uint8_t extraBits;    // extra bits after the last code in the entry
+    };
+
+    bool decodeLong(BitReader& reader, int16_t& delta) const;
+
+    std::vector<Entry> lookup;
+    std::vector<uint8_t> symbols;
+    uint64_t firstCode[MAX_CODE_LENGTH + 1];
+    uint32_t firstIndex[MAX_CODE_LENGTH + 1];
+    uint32_t countAtLength[MAX_CODE_LENGTH + 1];
+    unsigned maxLength = 0;
+    unsigned lookupBits = 0;
+};
+
+// Minimum-redundancy code lengths, computed in place without allocating
+// (Moffat & Katajainen). On input `weights` holds count symbol frequencies in
+// non-decreasing order; on output it holds their code lengths, which are
+// non-increasing. A single symbol gets length 1.
+void huffmanCodeLengths(uint32_t* weights, size_t count);
+
+// Caps code lengths from huffmanCodeLengths at maxLength and repairs the Kraft
+// sum, lengthening the lightest symbols first. Needs count <= 2^maxLength.
+void huffmanLimitCodeLengths(uint32_t* lengths, size_t count, unsigned maxLength);
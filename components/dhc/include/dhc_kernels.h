@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Delta and prefix-sum kernels. Samples are raw native-endian 16-bit values at
+// any alignment; arithmetic wraps modulo 2^16 like the scalar loops.
+struct DhcKernels {
+    const char* name;
+    // deltas[i] = sample[i] - sample[i - 1], sample[-1] being previous
+    void (*delta)(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas);
+    // sample[i] = sample[i - 1] + deltas[i], sample[-1] being previous
+    void (*prefixSum)(const int16_t* deltas, size_t count, uint16_t previous, uint8_t* output);
+};
+
+// Fastest variant for this CPU, chosen once on first use
+const DhcKernels& dhcKernels();
+
+// All variants this build and CPU support, scalar first; for benchmarks
+size_t dhcKernelVariants(const DhcKernels** variants, size_t max_variants);
+
+// Interleaved channels and other sample formats go through the predictor
+// loops of dhc_predictor.h instead; gathers would eat the gain of a vector loop.
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "dhc.h"
+
+// Compresses and decompresses independently decodable blocks on a pool of
+// workers, each with its own DHC codec. Finished blocks pass a reorder stage
+// and come out in input order, so buffers and files are byte for byte what DHC
+// writes with the same block size and without table reuse, and decode with
+// DHC as well.
+//
+// Workers are FreeRTOS tasks pinned to the cores on the device, the first to
+// the last core so that one worker leaves core 0 to acquisition, and
+// std::threads on the host. At most max_in_flight jobs are queued or held for
+// reordering at any time, which bounds the memory in use.
+class DHCParallel {
+public:
+    // 0 workers: one per core; 0 in flight: twice the workers
+    explicit DHCParallel(unsigned workers = 0, unsigned max_in_flight = 0);
+    ~DHCParallel();
+    unsigned workers() const { return static_cast<unsigned>(pool.size()); }
+
+    // Settings of every worker's codec, see DHC. Table reuse is not offered:
+    // its blocks would depend on each other.
+    void set_engine(DHC::Engine engine);
+    bool set_predictor(unsigned order);
+    bool set_static_table(uint8_t table_id);
+    bool set_channels(unsigned channels);
+    // Frames per block for compress() (default 4096); files use DHC::CHUNK_SIZE
+    bool set_block_samples(size_t block_samples);
+
+    // Same formats as the DHC functions of the same name
+    bool compress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size);
+    bool decompress(const uint8_t* input, size_t input_size, uint8_t* output, size_t* output_size);
+    // Largest compress() output for input_size bytes, see DHC::compress_bound
+    size_t compress_bound(size_t input_size) const;
+    bool compress_file(const char* input_file, const char* output_file);
+    bool decompress_file(const char* input_file, const char* output_file);
+
+    // Acquisition loops: submit() copies a chunk and queues it without waiting,
+    // and returns false if max_in_flight chunks are already outstanding; next()
+    // waits for the oldest chunk and returns it compressed exactly as
+    // DHC::compress would. Not to be mixed with the calls above while chunks
+    // are outstanding.
+    bool submit(const uint8_t* input, size_t input_size);
+    bool next(std::vector<uint8_t>& compressed);
+    size_t outstanding() const;
+
+private:
+    enum JobKind : uint8_t { JOB_BLOCKS, JOB_CHUNK, JOB_DECODE };
+    enum SlotState : uint8_t { SLOT_FREE, SLOT_QUEUED, SLOT_BUSY, SLOT_DONE };
+
+    // One job: frames to compress, or whole channel groups of blocks to decode
+    struct Slot {
+        JobKind kind;
+        const uint8_t* input;
+        size_t size;                  // bytes, or frames for JOB_BLOCKS
+        std::vector<uint8_t> owned;   // copy of the input, when the caller's may go away
+        std::vector<uint8_t> context; // JOB_DECODE: [channel][block header and table] of earlier tables
+        std::vector<uint8_t> output;  // compressed blocks or decoded samples
+        unsigned channels;
+        bool ok;
+        SlotState state = SLOT_FREE;
+    };
+
+    struct Worker;
+    std::vector<std::unique_ptr<Worker>> pool;
+    std::vector<Slot> slots;                   // ring, indexed by sequence number
+    size_t blockSamples = 4096;
+    unsigned channelCount = 1;
+
+    // Sequence numbers: next job to fill, to start and to hand back
+    uint64_t filled = 0;
+    uint64_t started = 0;
+    uint64_t consumed = 0;
+    bool stopping = false;
+    unsigned running = 0;  // workers that have not exited yet
+    mutable std::mutex lock;
+    std::condition_variable workAvailable;  // workers wait for queued jobs
+    std::condition_variable slotChanged;    // producer and consumer wait for slots
+
+    void startWorkers(unsigned count);
+    void stopWorkers();
+    static void workerEntry(void* context);
+    void workerLoop(DHC& codec);
+    static bool runJob(DHC& codec, Slot& slot);
+    static bool appendFrames(DHC& codec, const uint8_t* input, size_t frames, unsigned channels, size_t blockFrames,
+                             std::vector<uint8_t>& output);
+    static bool decodeJob(DHC& codec, Slot& slot);
+    bool ready(const char* operation) const;
+
+    // Ordered queue: the producer fills the next slot, workers run it, and
+    // the consumer takes slots back in order. The producer must not fill a
+    // full ring.
+    bool ringFull() const;
+    Slot& nextSlot() { return slots[filled % slots.size()]; }
+    void queueSlot();
+    Slot& waitOldest();
+    void releaseOldest();
+    void drain();
+
+    // Decode jobs cut a container into runs of whole channel groups
+    struct DecodeSplitter;
+    bool queueDecodeJob(DecodeSplitter& splitter, const uint8_t* input, size_t size);
+};
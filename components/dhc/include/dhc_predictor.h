@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Fixed linear predictors in the style of FLAC. Order n predicts a sample from
+// the n samples before it:
+//   0: 0
+//   1: s[i-1]
+//   2: 2 s[i-1] - s[i-2]
+//   3: 3 s[i-1] - 3 s[i-2] + s[i-3]
+//   4: 4 s[i-1] - 6 s[i-2] + 4 s[i-3] - s[i-4]
+// and the residual is the sample minus the prediction, modulo 2^16, so every
+// order round-trips any input exactly. Only the sample before a block is carried
+// over, so sample i of a block uses order min(n, i + 1).
+//
+// Samples are read from and written to raw data in one of the formats of
+// dhc_samples.h, one 16-bit plane at a time: the samples at index first,
+// first + stride, ... of the data, at any alignment.
+static const unsigned DHC_MAX_PREDICTOR_ORDER = 4;
+
+// Predictor loops compiled for one plane of one sample format
+struct DhcSampleCoder {
+    unsigned bits;  // bits of the plane, for byte counts
+    // Order with the smallest sum of residual magnitudes over the block, from
+    // one pass over the samples
+    unsigned (*choosePredictor)(const uint8_t* input, size_t first, size_t count, size_t stride);
+    void (*predict)(const uint8_t* input, size_t first, size_t count, size_t stride, uint16_t previous,
+                    unsigned order, int16_t* residuals);
+    void (*unpredict)(const int16_t* residuals, size_t count, uint16_t previous, unsigned order, uint8_t* output,
+                      size_t first, size_t stride);
+    uint16_t (*load)(const uint8_t* data, size_t index);
+    // Plain native 16-bit samples, for which the delta kernels of
+    // dhc_kernels.h do order 1 on contiguous samples
+    bool native;
+};
+
+// Plane 0 or 1 of a sample format; null for unsupported formats and planes
+const DhcSampleCoder* dhcSampleCoder(uint8_t format, unsigned plane);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dhc_alphabet.h"
+#include "dhc_bitstream.h"
+
+// Table-free Rice coding of deltas. A delta is zig-zag mapped to an unsigned
+// value u (0, -1, 1, -2, ... become 0, 1, 2, 3, ...), then written as the
+// quotient u >> k in unary (ones ended by a zero) followed by the k low bits.
+// Quotients of RICE_ESCAPE_QUOTIENT or more are written as that many ones and
+// u as a raw 16-bit value, so no code is longer than 32 bits. The parameter k
+// adapts to every block: it is chosen from the block's magnitude distribution.
+static const unsigned RICE_MAX_PARAMETER = 15;
+static const unsigned RICE_ESCAPE_QUOTIENT = 16;
+
+constexpr uint16_t riceZigZag(int16_t delta) {
+    return static_cast<uint16_t>((static_cast<uint16_t>(delta) << 1) ^ static_cast<uint16_t>(delta >> 15));
+}
+
+inline int16_t riceUnZigZag(uint32_t value) {
+    return static_cast<int16_t>((value >> 1) ^ (0u - (value & 1)));
+}
+
+// Bits of one zig-zag value at parameter k
+inline unsigned riceCodeLength(uint32_t value, unsigned k) {
+    uint32_t quotient = value >> k;
+    return quotient < RICE_ESCAPE_QUOTIENT ? quotient + 1 + k : RICE_ESCAPE_QUOTIENT + 16;
+}
+
+// Parameter for a block from one pass over its deltas, without a histogram
+// over the alphabet
+unsigned riceParameter(const int16_t* deltas, size_t count);
+
+// Best parameter and its cost in bits, estimated from a histogram over the
+// alphabet of dhc_alphabet.h (one value per magnitude class), without touching
+// the samples again
+unsigned riceEstimate(const uint32_t* frequencies, uint64_t* bits);
+
+void riceEncode(BitWriter& writer, const int16_t* deltas, size_t count, unsigned k);
+bool riceDecode(BitReader& reader, int16_t* deltas, size_t count, unsigned k);
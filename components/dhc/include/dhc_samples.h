@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Raw sample layouts. A sample format byte holds the bits per sample (8, 12,
+// 16, 24 or 32) in its low bits, plus flags for signed samples and for
+// big-endian byte order. 12-bit samples are packed, two in three bytes:
+// little-endian puts the low byte of the first sample first, with its top
+// nibble in the low half of the middle byte; big-endian puts its high byte
+// first, with its low nibble in the high half of the middle byte.
+//
+// The codec works on 16-bit planes: samples of up to 16 bits are one plane,
+// sign- or zero-extended to 16 bits; wider samples are split into their low
+// 16 bits and the (extended) bits above them, and every plane is predicted and
+// coded like a channel of its own. Arithmetic modulo 2^16 on the low plane is
+// exact, so its residuals are the residuals of the whole sample.
+static const uint8_t DHC_SAMPLE_BITS_MASK = 0x3F;
+static const uint8_t DHC_SAMPLE_SIGNED = 0x40;
+static const uint8_t DHC_SAMPLE_BIG_ENDIAN = 0x80;
+static const uint8_t DHC_SAMPLE_DEFAULT = 16;  // 16-bit little-endian
+static const unsigned DHC_MAX_SAMPLE_PLANES = 2;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const bool DHC_HOST_BIG_ENDIAN = true;
+#else
+static const bool DHC_HOST_BIG_ENDIAN = false;
+#endif
+
+static inline unsigned dhcSampleBits(uint8_t format) {
+    return format & DHC_SAMPLE_BITS_MASK;
+}
+
+static inline unsigned dhcSamplePlanes(uint8_t format) {
+    return dhcSampleBits(format) > 16 ? 2 : 1;
+}
+
+// Bytes taken by count samples, and whole samples in size bytes
+static inline size_t dhcSampleBytes(uint8_t format, size_t count) {
+    return (count * dhcSampleBits(format) + 7) / 8;
+}
+
+static inline size_t dhcSampleCount(uint8_t format, size_t size) {
+    return size * 8 / dhcSampleBits(format);
+}
+
+// Layout of one format, resolved at compile time so that sample loops carry
+// no per-sample branches. load() returns the sample extended to 32 bits;
+// storePlane() writes the bytes of one plane of a sample and leaves the rest.
+template <unsigned Bits, bool Signed, bool BigEndian>
+struct DhcSampleLayout {
+    static const unsigned BYTES = Bits / 8;
+
+    static inline uint32_t load(const uint8_t* data, size_t index) {
+        uint32_t raw;
+        if constexpr (Bits == 8) {
+            raw = data[index];
+        } else if constexpr (Bits == 16 || Bits == 32) {
+            // One load, which keeps the loops vectorizable
+            typedef typename std::conditional<Bits == 16, uint16_t, uint32_t>::type Word;
+            Word word;
+            memcpy(&word, data + index * BYTES, sizeof(word));
+            if constexpr (BigEndian != DHC_HOST_BIG_ENDIAN) {
+                if constexpr (Bits == 16) {
+                    word = __builtin_bswap16(word);
+                } else {
+                    word = __builtin_bswap32(word);
+                }
+            }
+            raw = word;
+        } else if constexpr (Bits == 12) {
+            const uint8_t* pair = data + index / 2 * 3;
+            if (BigEndian) {
+                raw = index % 2 == 0 ? (pair[0] << 4) | (pair[1] >> 4) : ((pair[1] & 0x0F) << 8) | pair[2];
+            } else {
+                raw = index % 2 == 0 ? pair[0] | ((pair[1] & 0x0F) << 8) : (pair[1] >> 4) | (pair[2] << 4);
+            }
+        } else {
+            const uint8_t* bytes = data + index * BYTES;
+            raw = 0;
+            for (unsigned i = 0; i < BYTES; i++) {
+                raw |= static_cast<uint32_t>(bytes[i]) << (8 * (BigEndian ? BYTES - 1 - i : i));
+            }
+        }
+        if (Signed && Bits < 32) {
+            return static_cast<uint32_t>(static_cast<int32_t>(raw << (32 - Bits)) >> (32 - Bits));
+        }
+        return raw;
+    }
+
+    template <unsigned Plane>
+    static inline void storePlane(uint8_t* data, size_t index, uint16_t value) {
+        if constexpr (Bits == 12) {
+            uint8_t* pair = data + index / 2 * 3;
+            if (BigEndian) {
+                if (index % 2 == 0) {
+                    pair[0] = static_cast<uint8_t>(value >> 4);
+                    pair[1] = static_cast<uint8_t>((pair[1] & 0x0F) | (value << 4));
+                } else {
+                    pair[1] = static_cast<uint8_t>((pair[1] & 0xF0) | ((value >> 8) & 0x0F));
+                    pair[2] = static_cast<uint8_t>(value);
+                }
+            } else {
+                if (index % 2 == 0) {
+                    pair[0] = static_cast<uint8_t>(value);
+                    pair[1] = static_cast<uint8_t>((pair[1] & 0xF0) | ((value >> 8) & 0x0F));
+                } else {
+                    pair[1] = static_cast<uint8_t>((pair[1] & 0x0F) | (value << 4));
+                    pair[2] = static_cast<uint8_t>(value >> 4);
+                }
+            }
+        } else if constexpr (Bits == 16) {
+            if constexpr (BigEndian != DHC_HOST_BIG_ENDIAN) value = __builtin_bswap16(value);
+            memcpy(data + index * BYTES, &value, sizeof(value));
+        } else {
+            // Bytes whose bits fall into this plane
+            uint8_t* bytes = data + index * BYTES;
+            for (unsigned i = 0; i < BYTES; i++) {
+                unsigned shift = 8 * (BigEndian ? BYTES - 1 - i : i);
+                if (shift >= 16 * Plane && shift < 16 * (Plane + 1)) {
+                    bytes[i] = static_cast<uint8_t>(value >> (shift - 16 * Plane));
+                }
+            }
+        }
+    }
+};
+
+// One 16-bit plane of a layout, as read and written by the predictor
+template <typename Layout, unsigned Plane>
+struct DhcSamplePlane {
+    static inline uint16_t load(const uint8_t* data, size_t index) {
+        return static_cast<uint16_t>(Layout::load(data, index) >> (16 * Plane));
+    }
+    static inline void store(uint8_t* data, size_t index, uint16_t value) {
+        Layout::template storePlane<Plane>(data, index, value);
+    }
+};
+
+// An odd number of packed 12-bit samples leaves half of the last byte unused;
+// it is cleared so that output does not depend on earlier buffer contents
+static inline void dhcClearSamplePadding(uint8_t format, uint8_t* data, size_t count) {
+    if (dhcSampleBits(format) != 12 || count % 2 == 0) return;
+    uint8_t* last = data + count / 2 * 3 + 1;
+    *last &= (format & DHC_SAMPLE_BIG_ENDIAN) ? 0xF0 : 0x0F;
+}
+
+// Whether that unused half byte is clear; compressing input where it is not
+// would not round-trip
+static inline bool dhcSamplePaddingClear(uint8_t format, const uint8_t* data, size_t count) {
+    if (dhcSampleBits(format) != 12 || count % 2 == 0) return true;
+    const uint8_t last = data[count / 2 * 3 + 1];
+    return (last & ((format & DHC_SAMPLE_BIG_ENDIAN) ? 0x0F : 0xF0)) == 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dhc_alphabet.h"
+
+// Pretrained canonical Huffman tables referenced by ID from static blocks.
+// Symbols are alphabet symbols (dhc_alphabet.h) in canonical order, by code
+// length, then symbol. A static table codes the whole alphabet, so any delta
+// can be coded with it. Tables are generated with the host tool dhc_train
+// (see host/tools).
+
+// Longest code, so that a code and its extra bits fit one 32-bit write
+static const unsigned STATIC_TABLE_MAX_LENGTH = 32 - DHC_MAX_EXTRA_BITS;
+
+struct StaticTableSpec {
+    uint8_t id;
+    const char* name;
+    uint8_t maxLength;
+    const uint16_t* lengthCounts;  // maxLength entries, for lengths 1..maxLength
+    const uint8_t* symbols;
+    uint16_t symbolCount;
+};
+
+// Built-in table with the given ID, or nullptr
+const StaticTableSpec* dhcFindStaticTable(uint8_t id);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// Stage timing for DHC::get_stats(). Built only with DHC_STATS (CONFIG_DHC_STATS
+// on the device, the DHC_STATS CMake option on the host); without it every
+// macro below expands to nothing, so the codec carries no counting code.
+//
+// Ticks are CPU cycles on the device, read from the cycle counter of the core
+// running the caller, and nanoseconds from the steady clock on the host. The
+// 32-bit cycle counter wraps after some seconds, far longer than any stage.
+#if DHC_STATS
+
+#if defined(ESP_PLATFORM)
+#include "esp_cpu.h"
+typedef uint32_t DHCStatsTicks;
+static inline DHCStatsTicks dhcStatsNow() {
+    return esp_cpu_get_cycle_count();
+}
+#else
+#include <chrono>
+typedef uint64_t DHCStatsTicks;
+static inline DHCStatsTicks dhcStatsNow() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+}
+#endif
+
+// Starts a lap; each DHC_STATS_LAP adds the time since the last one to counter
+#define DHC_STATS_BEGIN(lap) DHCStatsTicks lap = dhcStatsNow()
+#define DHC_STATS_LAP(lap, counter)                                    \
+    do {                                                               \
+        DHCStatsTicks dhcStatsLapEnd = dhcStatsNow();                  \
+        (counter) += static_cast<DHCStatsTicks>(dhcStatsLapEnd - lap); \
+        lap = dhcStatsLapEnd;                                          \
+    } while (0)
+#define DHC_STATS_ADD(counter, value) ((counter) += (value))
+#define DHC_STATS_MAX(counter, value) ((counter) = (counter) < (value) ? (value) : (counter))
+
+#else
+
+#define DHC_STATS_BEGIN(lap) ((void)0)
+#define DHC_STATS_LAP(lap, counter) ((void)0)
+#define DHC_STATS_ADD(counter, value) ((void)0)
+#define DHC_STATS_MAX(counter, value) ((void)0)
+
+#endif
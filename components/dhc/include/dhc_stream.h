@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "dhc.h"
+
+// Streaming DHC encoder. Samples are pushed a few at a time and buffered
+// until a block of block_samples is complete; the delta chain continues
+// across blocks, so each block after the first is coded relative to the
+// last sample of the previous one. Encoded bytes are queued and drained with
+// pull() in any amount. flush() closes a short block so that everything
+// pushed so far can be pulled; the stream may continue afterwards.
+//
+// Smaller blocks give lower latency, larger blocks amortise the code table
+// carried by every block header.
+//
+// With several channels, samples are pushed interleaved and block_samples
+// counts frames; each channel keeps its own delta chain and code tables,
+// and flush() leaves an incomplete frame buffered.
+//
+// Samples are 16-bit little-endian unless another whole-byte format is set
+// (8, 16, 24 or 32 bits, see DHC::set_sample_format); the stream header
+// records it. Packed 12-bit samples are for buffers only.
+class DHCStreamEncoder {
+public:
+    static const uint16_t STREAM_MAGIC = 0x4453;  // "DS"
+    static const uint16_t STREAM_CHANNELS_MAGIC = 0x4443;  // "DC": channel count byte follows
+    static const uint16_t STREAM_FORMAT_MAGIC = 0x4455;    // "DU": channel count and sample format bytes follow
+    static const size_t DEFAULT_BLOCK_SAMPLES = 512;
+
+    explicit DHCStreamEncoder(size_t block_samples = DEFAULT_BLOCK_SAMPLES);
+
+    // 16-bit samples, for the default format only
+    bool push(const uint16_t* samples, size_t count);
+    // Raw sample bytes in the sample format; a trailing partial sample is kept
+    // for the next call
+    bool push_bytes(const uint8_t* data, size_t size);
+    size_t pull(uint8_t* output, size_t capacity);
+    // With end_of_input, a partial sample or incomplete frame left over is an
+    // error instead of waiting for more input
+    bool flush(bool end_of_input = false);
+
+    // Takes effect from the next block; buffered samples beyond the new size are encoded
+    bool set_block_samples(size_t block_samples);
+    size_t block_samples() const { return blockSamples; }
+    // Code table reuse across blocks, see DHC::set_table_reuse
+    void set_table_reuse(bool enable, unsigned drift_percent = 10) {
+        codec.set_table_reuse(enable, drift_percent);
+    }
+    // Static code tables, see DHC::set_static_table
+    bool set_static_table(uint8_t table_id) { return codec.set_static_table(table_id); }
+    bool load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size) {
+        return codec.load_static_table(table_id, table, table_size);
+    }
+    // Entropy coder, see DHC::set_engine
+    void set_engine(DHC::Engine engine) { codec.set_engine(engine); }
+    // Interleaved channels, see DHC::set_channels; only before the first push
+    bool set_channels(unsigned channels);
+    // Sample format, see DHC::set_sample_format; only before the first push
+    bool set_sample_format(uint8_t format);
+    uint8_t sample_format() const { return codec.sample_format(); }
+    size_t pending() const { return queue.size() - queueHead; }
+    // Counters of the codec, see DHC::get_stats; reset() leaves them
+    DHC::Stats get_stats() const { return codec.get_stats(); }
+    void reset_stats() { codec.reset_stats(); }
+    void reset();
+
+private:
+    bool bufferSamples(const uint8_t* data, size_t count);
+    bool encodeBuffered();
+
+    DHC codec;
+    size_t blockSamples;
+    size_t sampleBytes = 2;
+    std::vector<uint8_t> buffer;                // raw samples
+    size_t buffered = 0;                        // in samples
+    uint16_t previous[DHC::MAX_LANES] = {};     // last plane value of every lane
+    bool headerWritten = false;
+    uint8_t partial[4] = {};                    // a sample split across push_bytes() calls
+    size_t partialBytes = 0;
+    std::vector<uint8_t> queue;
+    size_t queueHead = 0;
+};
+
+// Streaming DHC decoder: accepts the encoder output in arbitrary fragments
+// and hands back samples as soon as each block is complete, in the sample
+// format the stream header records.
+class DHCStreamDecoder {
+public:
+    DHCStreamDecoder();
+
+    bool push(const uint8_t* data, size_t size);
+    // 16-bit samples, for streams of the default format only
+    size_t pull(uint16_t* samples, size_t capacity);
+    // Raw sample bytes, whole samples only; returns the bytes copied
+    size_t pull_bytes(uint8_t* output, size_t capacity);
+    // Decoded samples not pulled yet
+    size_t pending() const { return (decoded.size() - decodedHead) / sampleBytes; }
+    uint8_t sample_format() const { return sampleFormat; }
+    // Hands every block (one per channel, interleaved) to sink as soon as it
+    // is decoded instead of queuing it for pull(); see DHC::SampleSink. Null
+    // goes back to queuing. Samples of up to 16 bits reach the sink widened
+    // to 16 bits; wider formats cannot be decoded to a sink.
+    void set_sink(DHC::SampleSink sink, void* context) {
+        this->sink = sink;
+        sinkContext = context;
+    }
+    // Built-in tables are found by ID; tables loaded into the encoder must be loaded here too
+    bool load_static_table(uint8_t table_id, const uint8_t* table, size_t table_size) {
+        return codec.load_static_table(table_id, table, table_size);
+    }
+    DHC::Stats get_stats() const { return codec.get_stats(); }
+    void reset_stats() { codec.reset_stats(); }
+    void reset();
+
+private:
+    bool decodeAvailable();
+    bool useSampleFormat(uint8_t format);
+
+    DHC codec;
+    std::vector<uint8_t> input;
+    size_t inputHead = 0;
+    bool headerSeen = false;
+    unsigned channels = 1;
+    uint8_t sampleFormat = DHC::SAMPLE_DEFAULT;
+    unsigned planes = 1;
+    size_t sampleBytes = 2;
+    const DhcSampleCoder* coders[DHC_MAX_SAMPLE_PLANES] = {};
+    unsigned nextLane = 0;                      // lane of the next block
+    uint16_t previous[DHC::MAX_LANES] = {};
+    std::vector<uint8_t> frames;                // blocks of one range, interleaved
+    bool framesToSink = false;                  // frames hold 16-bit values for the sink
+    DHC::SampleSink sink = nullptr;
+    void* sinkContext = nullptr;
+    std::vector<uint8_t> decoded;               // raw samples
+    size_t decodedHead = 0;                     // in bytes
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Deterministic synthetic sensor signals shared by the host benchmarks.
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct BenchSignal {
+    std::string name;
+    std::vector<uint16_t> samples;
+};
+
+inline uint16_t clampSample(double v) {
+    if (v < 0.0) return 0;
+    if (v > 65535.0) return 65535;
+    return static_cast<uint16_t>(v);
+}
+
+// Slow sine around mid-scale, like a well-behaved analog channel
+inline std::vector<uint16_t> makeSine(size_t count) {
+    std::vector<uint16_t> out(count);
+    for (size_t i = 0; i < count; i++) {
+        out[i] = clampSample(32768.0 + 12000.0 * std::sin(i * 0.01));
+    }
+    return out;
+}
+
+// Random walk with small steps, like a drifting temperature or pressure sensor
+inline std::vector<uint16_t> makeRandomWalk(size_t count, uint32_t seed = 1) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> step(-8, 8);
+    std::vector<uint16_t> out(count);
+    int32_t value = 32768;
+    for (size_t i = 0; i < count; i++) {
+        value += step(rng);
+        if (value < 0) value = 0;
+        if (value > 65535) value = 65535;
+        out[i] = static_cast<uint16_t>(value);
+    }
+    return out;
+}
+
+// ECG-like trace at 250 Hz: baseline wander, P/QRS/T waves and gaussian noise
+inline std::vector<uint16_t> makeNoisyEcg(size_t count, uint32_t seed = 2) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> noise(0.0, 6.0);
+    const double fs = 250.0;
+    const double beat = 0.8;  // seconds per beat
+    std::vector<uint16_t> out(count);
+    for (size_t i = 0; i < count; i++) {
+        double t = i / fs;
+        double phase = std::fmod(t, beat) / beat;
+        double v = 2048.0 + 40.0 * std::sin(2.0 * M_PI * 0.3 * t);
+        v += 60.0 * std::exp(-std::pow((phase - 0.20) / 0.025, 2));   // P
+        v -= 80.0 * std::exp(-std::pow((phase - 0.33) / 0.008, 2));   // Q
+        v += 900.0 * std::exp(-std::pow((phase - 0.35) / 0.010, 2));  // R
+        v -= 150.0 * std::exp(-std::pow((phase - 0.37) / 0.010, 2));  // S
+        v += 180.0 * std::exp(-std::pow((phase - 0.60) / 0.050, 2));  // T
+        out[i] = clampSample(v + noise(rng));
+    }
+    return out;
+}
+
+inline std::vector<uint16_t> makeConstant(size_t count) {
+    return std::vector<uint16_t>(count, 1234);
+}
+
+inline std::vector<BenchSignal> makeBenchSignals(size_t count) {
+    return {
+        {"sine", makeSine(count)},
+        {"random_walk", makeRandomWalk(count)},
+        {"noisy_ecg", makeNoisyEcg(count)},
+        {"constant", makeConstant(count)},
+    };
+}
@@ -0,0 +1,211 @@
+// Host throughput benchmark for DHC::compress / DHC::decompress.
+//
+// Every synthetic signal is cut into blocks of each requested size, and each
+// block is compressed and decompressed independently, the way app_main feeds
+// the codec. Timings are the best of several repetitions so that numbers are
+// comparable between runs on a loaded build server.
+#include "dhc.h"
+#include "bench_signals.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    size_t samples = 1 << 18;
+    int reps = 3;
+    std::vector<size_t> blockSizes = {256, 512, 2048, 8192};
+    DHC::Engine engine = DHC::ENGINE_AUTO;
+    unsigned predictor = DHC::PREDICTOR_AUTO;
+};
+
+struct StageResult {
+    double seconds = 0.0;
+};
+
+double nowSeconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+void printUsage(const char* argv0) {
+    printf("usage: %s [--samples N] [--reps N] [--blocks a,b,c] [--engine E] [--predictor P]\n", argv0);
+    printf("  --samples N    samples per synthetic signal (default 262144)\n");
+    printf("  --reps N       repetitions, best time is reported (default 3)\n");
+    printf("  --blocks LIST  comma separated block sizes in samples (default 256,512,2048,8192)\n");
+    printf("  --engine E     auto, huffman or rice (default auto)\n");
+    printf("  --predictor P  auto or a fixed order 0..4 (default auto)\n");
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            options.samples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = atoi(argv[++i]);
+        } else if (arg == "--blocks" && i + 1 < argc) {
+            options.blockSizes.clear();
+            const char* p = argv[++i];
+            while (*p) {
+                char* end;
+                size_t size = strtoul(p, &end, 10);
+                if (end == p || size == 0) return false;
+                options.blockSizes.push_back(size);
+                p = (*end == ',') ? end + 1 : end;
+            }
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "auto") {
+                options.engine = DHC::ENGINE_AUTO;
+            } else if (engine == "huffman") {
+                options.engine = DHC::ENGINE_HUFFMAN;
+            } else if (engine == "rice") {
+                options.engine = DHC::ENGINE_RICE;
+            } else {
+                return false;
+            }
+        } else if (arg == "--predictor" && i + 1 < argc) {
+            std::string predictor = argv[++i];
+            if (predictor == "auto") {
+                options.predictor = DHC::PREDICTOR_AUTO;
+            } else if (predictor.size() == 1 && predictor[0] >= '0' && predictor[0] <= '4') {
+                options.predictor = predictor[0] - '0';
+            } else {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return options.samples > 0 && options.reps > 0 && !options.blockSizes.empty();
+}
+
+bool runCase(const BenchSignal& signal, size_t blockSamples, const BenchOptions& options) {
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(signal.samples.data());
+    const size_t totalSamples = signal.samples.size();
+    const size_t blockCount = (totalSamples + blockSamples - 1) / blockSamples;
+
+    std::vector<std::vector<uint8_t>> compressed(blockCount);
+    std::vector<uint8_t> decoded(blockSamples * sizeof(uint16_t));
+    StageResult encode, decode;
+    encode.seconds = decode.seconds = 1e30;
+    size_t compressedBytes = 0;
+
+    for (int rep = 0; rep < options.reps; rep++) {
+        DHC codec;
+        codec.set_engine(options.engine);
+        codec.set_predictor(options.predictor);
+        compressedBytes = 0;
+
+        double start = nowSeconds();
+        for (size_t b = 0; b < blockCount; b++) {
+            size_t first = b * blockSamples;
+            size_t count = std::min(blockSamples, totalSamples - first);
+            std::vector<uint8_t>& out = compressed[b];
+            out.resize(codec.compress_bound(count * sizeof(uint16_t)));
+            size_t outSize = out.size();
+            if (!codec.compress(input + first * sizeof(uint16_t), count * sizeof(uint16_t),
+                                out.data(), &outSize)) {
+                fprintf(stderr, "%s/%zu: compress failed on block %zu\n",
+                        signal.name.c_str(), blockSamples, b);
+                return false;
+            }
+            out.resize(outSize);
+            compressedBytes += outSize;
+        }
+        encode.seconds = std::min(encode.seconds, nowSeconds() - start);
+
+        double decodeSeconds = 0.0;
+        for (size_t b = 0; b < blockCount; b++) {
+            size_t first = b * blockSamples;
+            size_t count = std::min(blockSamples, totalSamples - first);
+            size_t decodedSize = decoded.size();
+            double blockStart = nowSeconds();
+            bool ok = codec.decompress(compressed[b].data(), compressed[b].size(),
+                                       decoded.data(), &decodedSize);
+            decodeSeconds += nowSeconds() - blockStart;
+            if (!ok || decodedSize != count * sizeof(uint16_t) ||
+                memcmp(decoded.data(), input + first * sizeof(uint16_t), decodedSize) != 0) {
+                fprintf(stderr, "%s/%zu: round trip mismatch on block %zu\n",
+                        signal.name.c_str(), blockSamples, b);
+                return false;
+            }
+        }
+        decode.seconds = std::min(decode.seconds, decodeSeconds);
+    }
+
+    const double inputMB = totalSamples * sizeof(uint16_t) / 1e6;
+    const double ratio = static_cast<double>(compressedBytes) / (totalSamples * sizeof(uint16_t));
+    printf("%-12s %7zu %7.3f %9.1f %10.2f %8.1f %9.1f %10.2f %8.1f\n",
+           signal.name.c_str(), blockSamples, ratio,
+           inputMB / encode.seconds, totalSamples / encode.seconds / 1e6,
+           encode.seconds * 1e9 / totalSamples,
+           inputMB / decode.seconds, totalSamples / decode.seconds / 1e6,
+           decode.seconds * 1e9 / totalSamples);
+    return true;
+}
+
+// A workspace of workspace_size(n) bytes must give blocks of exactly n samples
+bool checkWorkspaceSizes(const BenchSignal& signal) {
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(signal.samples.data());
+    std::vector<size_t> sizes;
+    for (size_t n = 1; n <= 1024; n++) {
+        sizes.push_back(n);
+    }
+    const size_t larger[] = {2047, 2048, 4095, 4097, 32767, DHC::MAX_BLOCK_SAMPLES - 1};
+    sizes.insert(sizes.end(), std::begin(larger), std::end(larger));
+    DHC codec;
+    std::vector<uint8_t> workspace, out;
+    for (size_t n : sizes) {
+        size_t count = std::min(n + 1, signal.samples.size());
+        workspace.resize(DHC::workspace_size(n));
+        out.resize(codec.compress_bound(count * sizeof(uint16_t), n));
+        size_t outSize = out.size();
+        DHC::ContainerInfo info;
+        DHC::BlockInfo block;
+        if (!codec.compress(input, count * sizeof(uint16_t), out.data(), &outSize, workspace.data(),
+                            workspace.size()) ||
+            !DHC::inspect(out.data(), outSize, &info) ||
+            !codec.block_info(out.data() + info.blocksBegin, outSize - info.blocksBegin, &block) ||
+            block.samples != std::min(n, count)) {
+            fprintf(stderr, "workspace_size(%zu) does not give blocks of %zu samples\n", n, n);
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    static const char* const engineNames[] = {"auto", "huffman", "rice"};
+    std::string predictor = options.predictor == DHC::PREDICTOR_AUTO ? "auto" : std::to_string(options.predictor);
+    printf("samples per signal: %zu, repetitions: %d, engine: %s, predictor: %s\n", options.samples, options.reps,
+           engineNames[options.engine], predictor.c_str());
+    printf("%-12s %7s %7s %9s %10s %8s %9s %10s %8s\n", "", "", "",
+           "compress", "", "", "decomp", "", "");
+    printf("%-12s %7s %7s %9s %10s %8s %9s %10s %8s\n", "signal", "block", "ratio",
+           "MB/s", "Msample/s", "ns/samp", "MB/s", "Msample/s", "ns/samp");
+
+    std::vector<BenchSignal> signals = makeBenchSignals(options.samples);
+    bool ok = signals.empty() || checkWorkspaceSizes(signals[0]);
+    for (const BenchSignal& signal : signals) {
+        for (size_t blockSamples : options.blockSizes) {
+            ok = runCase(signal, blockSamples, options) && ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
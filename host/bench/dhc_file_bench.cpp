@@ -0,0 +1,218 @@
+// Host benchmark for the buffered file paths, DHC::compress_file and
+// DHC::decompress_file.
+//
+// Every synthetic signal is written to a file, then compressed and
+// decompressed through files with each requested buffer size, with and without
+// the background I/O task, and the output is checked against the input.
+// Speedup is relative to the first buffer size without background I/O. The
+// page cache hides most of the storage latency here, so the numbers mostly
+// show the cost of many small calls; on FATFS over SPI flash every call is far
+// more expensive, and the overlap from background I/O grows accordingly.
+// decompress_range is checked first on a file written with table reuse.
+#include "dhc.h"
+#include "bench_signals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    size_t samples = 1 << 22;
+    int reps = 3;
+    std::vector<size_t> bufferSizes = {512, 4096, 16384, 65536};
+    std::string dir = ".";
+};
+
+double nowSeconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+void printUsage(const char* argv0) {
+    printf("usage: %s [--samples N] [--reps N] [--buffers a,b,c] [--dir PATH]\n", argv0);
+    printf("  --samples N    samples per synthetic signal (default 4194304)\n");
+    printf("  --reps N       repetitions, best time is reported (default 3)\n");
+    printf("  --buffers LIST comma separated file buffer sizes in bytes (default 512,4096,16384,65536)\n");
+    printf("  --dir PATH     directory for the scratch files (default .)\n");
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            options.samples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = atoi(argv[++i]);
+        } else if (arg == "--buffers" && i + 1 < argc) {
+            options.bufferSizes.clear();
+            const char* p = argv[++i];
+            while (*p) {
+                char* end;
+                size_t size = strtoul(p, &end, 10);
+                if (end == p || size == 0) return false;
+                options.bufferSizes.push_back(size);
+                p = (*end == ',') ? end + 1 : end;
+            }
+        } else if (arg == "--dir" && i + 1 < argc) {
+            options.dir = argv[++i];
+        } else {
+            return false;
+        }
+    }
+    return options.samples > 0 && options.reps > 0 && !options.bufferSizes.empty();
+}
+
+bool writeFile(const std::string& path, const std::vector<uint16_t>& samples) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(samples.data(), sizeof(uint16_t), samples.size(), file) == samples.size();
+    return fclose(file) == 0 && ok;
+}
+
+bool sameContents(const std::string& path, const std::vector<uint16_t>& samples) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    std::vector<uint16_t> data(samples.size() + 1);
+    size_t count = fread(data.data(), sizeof(uint16_t), data.size(), file);
+    fclose(file);
+    return count == samples.size() && memcmp(data.data(), samples.data(), count * sizeof(uint16_t)) == 0;
+}
+
+struct CaseResult {
+    double compressSeconds = 1e30;
+    double decompressSeconds = 1e30;
+};
+
+bool runCase(const BenchSignal& signal, const std::string& input, size_t bufferSize, bool background,
+             const BenchOptions& options, CaseResult& result) {
+    const std::string compressed = options.dir + "/dhc_file_bench.dhc";
+    const std::string decoded = options.dir + "/dhc_file_bench.out";
+    DHC codec;
+    if (!codec.set_file_buffer(bufferSize, background)) {
+        return false;
+    }
+    for (int rep = 0; rep < options.reps; rep++) {
+        double start = nowSeconds();
+        if (!codec.compress_file(input.c_str(), compressed.c_str())) {
+            fprintf(stderr, "%s/%zu: compress_file failed\n", signal.name.c_str(), bufferSize);
+            return false;
+        }
+        result.compressSeconds = std::min(result.compressSeconds, nowSeconds() - start);
+
+        start = nowSeconds();
+        bool ok = codec.decompress_file(compressed.c_str(), decoded.c_str());
+        result.decompressSeconds = std::min(result.decompressSeconds, nowSeconds() - start);
+        if (!ok || !sameContents(decoded, signal.samples)) {
+            fprintf(stderr, "%s/%zu: round trip mismatch\n", signal.name.c_str(), bufferSize);
+            return false;
+        }
+    }
+    remove(compressed.c_str());
+    remove(decoded.c_str());
+    return true;
+}
+
+// Walk with a few fixed step sizes, which only a Huffman table codes well, split
+// by white noise blocks. With a loose drift limit the kept table survives the
+// noise, which is stored, so the walk after it reuses a table sent before the
+// block a range may start at.
+std::vector<uint16_t> makeReuseAcrossNoise(size_t count) {
+    static const int steps[] = {0, 0, 0, 0, 0, 0, 7, 7, 7, -9, -9, -9, 30, -30, 100, -100};
+    const size_t block = DHC::CHUNK_SIZE / sizeof(uint16_t);
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<size_t> step(0, sizeof(steps) / sizeof(steps[0]) - 1);
+    std::uniform_int_distribution<int> noise(0, 65535);
+    std::vector<uint16_t> out(count);
+    int32_t value = 32768;
+    for (size_t i = 0; i < count; i++) {
+        if ((i / block) % 3 == 1) {
+            out[i] = static_cast<uint16_t>(noise(rng));
+            continue;
+        }
+        value = std::min(65535, std::max(0, value + steps[step(rng)]));
+        out[i] = static_cast<uint16_t>(value);
+    }
+    return out;
+}
+
+// Decodes a range starting inside every block with decompress_range and
+// checks it against the input, with table reuse and ENGINE_AUTO
+bool checkRanges(const BenchOptions& options) {
+    const size_t block = DHC::CHUNK_SIZE / sizeof(uint16_t);
+    const std::vector<uint16_t> samples = makeReuseAcrossNoise(std::min<size_t>(options.samples, 64 * block));
+    const std::string input = options.dir + "/dhc_file_bench_range.bin";
+    const std::string compressed = options.dir + "/dhc_file_bench_range.dhc";
+    DHC codec;
+    codec.set_engine(DHC::ENGINE_AUTO);
+    codec.set_table_reuse(true, 1000);
+    bool ok = writeFile(input, samples) && codec.compress_file(input.c_str(), compressed.c_str());
+    std::vector<uint16_t> range(2 * block);
+    for (size_t first = block / 2; ok && first < samples.size(); first += block) {
+        size_t count = std::min(range.size(), samples.size() - first);
+        size_t size = count * sizeof(uint16_t);
+        ok = codec.decompress_range(compressed.c_str(), first, count, reinterpret_cast<uint8_t*>(range.data()),
+                                    &size) &&
+             size == count * sizeof(uint16_t) &&
+             memcmp(range.data(), samples.data() + first, size) == 0;
+        if (!ok) {
+            fprintf(stderr, "decompress_range mismatch at sample %zu\n", first);
+        }
+    }
+    remove(input.c_str());
+    remove(compressed.c_str());
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    printf("samples per signal: %zu, repetitions: %d, scratch dir: %s\n", options.samples, options.reps,
+           options.dir.c_str());
+    printf("%-12s %8s %10s %9s %8s %9s %8s\n", "", "", "", "compress", "", "decomp", "");
+    printf("%-12s %8s %10s %9s %8s %9s %8s\n", "signal", "buffer", "background", "MB/s", "speedup", "MB/s",
+           "speedup");
+
+    bool ok = checkRanges(options);
+    const std::string input = options.dir + "/dhc_file_bench.bin";
+    for (const BenchSignal& signal : makeBenchSignals(options.samples)) {
+        if (!writeFile(input, signal.samples)) {
+            fprintf(stderr, "cannot write %s\n", input.c_str());
+            return 1;
+        }
+        const double inputMB = signal.samples.size() * sizeof(uint16_t) / 1e6;
+        CaseResult base;
+        bool haveBase = false;
+        for (size_t bufferSize : options.bufferSizes) {
+            for (bool background : {false, true}) {
+                CaseResult result;
+                if (!runCase(signal, input, bufferSize, background, options, result)) {
+                    ok = false;
+                    continue;
+                }
+                if (!haveBase) {
+                    base = result;
+                    haveBase = true;
+                }
+                printf("%-12s %8zu %10s %9.1f %8.2f %9.1f %8.2f\n", signal.name.c_str(), bufferSize,
+                       background ? "yes" : "no", inputMB / result.compressSeconds,
+                       base.compressSeconds / result.compressSeconds, inputMB / result.decompressSeconds,
+                       base.decompressSeconds / result.decompressSeconds);
+            }
+        }
+    }
+    remove(input.c_str());
+    return ok ? 0 : 1;
+}
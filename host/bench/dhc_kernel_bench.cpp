@@ -0,0 +1,159 @@
+// Host benchmark for the delta and prefix-sum kernels (dhc_kernels.h).
+//
+// Every kernel variant this CPU supports runs over the same buffer and is
+// checked against the scalar one. memcpy of the same amount of data is the
+// reference for "memory speed", and the std::vector loops the codec used
+// before the kernels existed are included for comparison.
+#include "dhc_kernels.h"
+#include "bench_signals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    size_t samples = 1 << 20;
+    int reps = 5;
+};
+
+double nowSeconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+void printUsage(const char* argv0) {
+    printf("usage: %s [--samples N] [--reps N]\n", argv0);
+    printf("  --samples N    samples per pass (default 1048576)\n");
+    printf("  --reps N       repetitions, best time is reported (default 5)\n");
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            options.samples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = atoi(argv[++i]);
+        } else {
+            return false;
+        }
+    }
+    return options.samples > 0 && options.reps > 0;
+}
+
+// Previous codec loops, kept here as the baseline
+void vectorDelta(const uint8_t* input, size_t count, uint16_t previous, int16_t* deltas) {
+    for (size_t i = 0; i < count; i++) {
+        uint16_t sample;
+        memcpy(&sample, input + i * sizeof(uint16_t), sizeof(sample));
+        deltas[i] = static_cast<int16_t>(sample - previous);
+        previous = sample;
+    }
+}
+
+std::vector<uint16_t> vectorReconstruct(const std::vector<int16_t>& deltas, uint16_t previous) {
+    std::vector<uint16_t> samples(deltas.size());
+    if (deltas.empty()) return samples;
+    int32_t accumulator = previous + deltas[0];
+    samples[0] = static_cast<uint16_t>(accumulator);
+    for (size_t i = 1; i < deltas.size(); i++) {
+        accumulator += deltas[i];
+        samples[i] = static_cast<uint16_t>(accumulator);
+    }
+    return samples;
+}
+
+template <typename F>
+double bestOf(int reps, F&& run) {
+    double best = 1e30;
+    for (int rep = 0; rep < reps; rep++) {
+        double start = nowSeconds();
+        run();
+        best = std::min(best, nowSeconds() - start);
+    }
+    return best;
+}
+
+void printRow(const char* name, double deltaSeconds, double prefixSeconds, size_t samples) {
+    const double mb = samples * sizeof(uint16_t) / 1e6;
+    printf("%-10s %10.1f %8.3f %10.1f %8.3f\n", name, mb / deltaSeconds, deltaSeconds * 1e9 / samples,
+           mb / prefixSeconds, prefixSeconds * 1e9 / samples);
+}
+
+// Odd lengths and offsets exercise the scalar tails and unaligned loads
+bool checkVariant(const DhcKernels& kernels, const std::vector<uint16_t>& signal) {
+    const DhcKernels* variants[1];
+    dhcKernelVariants(variants, 1);
+    const DhcKernels& scalar = *variants[0];
+    std::vector<uint8_t> input(signal.size() * 2 + 1);
+    std::vector<int16_t> expected(signal.size()), actual(signal.size());
+    std::vector<uint8_t> back(signal.size() * 2 + 1), reference(signal.size() * 2);
+    for (size_t offset = 0; offset < 2; offset++) {
+        memcpy(input.data() + offset, signal.data(), signal.size() * 2);
+        for (size_t count : {size_t(0), size_t(1), size_t(7), size_t(17), size_t(33), signal.size()}) {
+            scalar.delta(input.data() + offset, count, 4321, expected.data());
+            kernels.delta(input.data() + offset, count, 4321, actual.data());
+            if (memcmp(expected.data(), actual.data(), count * 2) != 0) return false;
+            scalar.prefixSum(expected.data(), count, 4321, reference.data());
+            kernels.prefixSum(expected.data(), count, 4321, back.data() + offset);
+            if (memcmp(reference.data(), back.data() + offset, count * 2) != 0 ||
+                memcmp(reference.data(), input.data() + offset, count * 2) != 0) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    std::vector<uint16_t> signal;
+    for (const BenchSignal& candidate : makeBenchSignals(options.samples)) {
+        if (candidate.name == "random_walk") signal = candidate.samples;
+    }
+    const size_t n = signal.size();
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(signal.data());
+    std::vector<int16_t> deltas(n);
+    std::vector<uint8_t> output(n * sizeof(uint16_t));
+
+    printf("samples: %zu, repetitions: %d, selected kernels: %s\n", n, options.reps, dhcKernels().name);
+    printf("%-10s %10s %8s %10s %8s\n", "", "delta", "", "prefix", "");
+    printf("%-10s %10s %8s %10s %8s\n", "kernel", "MB/s", "ns/samp", "MB/s", "ns/samp");
+
+    double copySeconds = bestOf(options.reps, [&] { memcpy(output.data(), input, n * 2); });
+    printRow("memcpy", copySeconds, copySeconds, n);
+
+    std::vector<int16_t> deltaVector(n);
+    volatile uint16_t sink = 0;  // keeps the returned vector alive
+    double deltaSeconds = bestOf(options.reps, [&] { vectorDelta(input, n, 0, deltaVector.data()); });
+    double prefixSeconds = bestOf(options.reps, [&] { sink = vectorReconstruct(deltaVector, 0).back(); });
+    printRow("vector", deltaSeconds, prefixSeconds, n);
+
+    bool ok = true;
+    const DhcKernels* variants[8];
+    size_t count = dhcKernelVariants(variants, 8);
+    for (size_t v = 0; v < count && v < 8; v++) {
+        const DhcKernels& kernels = *variants[v];
+        deltaSeconds = bestOf(options.reps, [&] { kernels.delta(input, n, 0, deltas.data()); });
+        prefixSeconds = bestOf(options.reps, [&] { kernels.prefixSum(deltas.data(), n, 0, output.data()); });
+        printRow(kernels.name, deltaSeconds, prefixSeconds, n);
+        if (!checkVariant(kernels, signal)) {
+            fprintf(stderr, "%s: result differs from the scalar kernels\n", kernels.name);
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Host scaling benchmark for DHCParallel.
+//
+// Every synthetic signal is compressed and decompressed as one buffer with
+// each requested number of workers, and the output is checked against the
+// input. Speedup is relative to the first worker count in the list; it can
+// only approach the worker count on a machine with that many free cores.
+#include "dhc_parallel.h"
+#include "bench_signals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    size_t samples = 1 << 22;
+    int reps = 3;
+    size_t blockSamples = 4096;
+    std::vector<unsigned> workers;
+};
+
+double nowSeconds() {
+    using clock = std::chrono::steady_clock;
+    return std::chrono::duration<double>(clock::now().time_since_epoch()).count();
+}
+
+void printUsage(const char* argv0) {
+    printf("usage: %s [--samples N] [--reps N] [--block N] [--workers a,b,c]\n", argv0);
+    printf("  --samples N    samples per synthetic signal (default 4194304)\n");
+    printf("  --reps N       repetitions, best time is reported (default 3)\n");
+    printf("  --block N      samples per block (default 4096)\n");
+    printf("  --workers LIST comma separated worker counts (default 1, 2, 4, ... up to the cores)\n");
+}
+
+bool parseOptions(int argc, char** argv, BenchOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--samples" && i + 1 < argc) {
+            options.samples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--reps" && i + 1 < argc) {
+            options.reps = atoi(argv[++i]);
+        } else if (arg == "--block" && i + 1 < argc) {
+            options.blockSamples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            options.workers.clear();
+            const char* p = argv[++i];
+            while (*p) {
+                char* end;
+                unsigned count = strtoul(p, &end, 10);
+                if (end == p || count == 0) return false;
+                options.workers.push_back(count);
+                p = (*end == ',') ? end + 1 : end;
+            }
+        } else {
+            return false;
+        }
+    }
+    if (options.workers.empty()) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned count = 1; count < cores; count *= 2) {
+            options.workers.push_back(count);
+        }
+        options.workers.push_back(cores);
+    }
+    return options.samples > 0 && options.reps > 0 && options.blockSamples > 0;
+}
+
+struct CaseResult {
+    double compressSeconds = 1e30;
+    double decompressSeconds = 1e30;
+};
+
+bool runCase(const BenchSignal& signal, unsigned workers, const BenchOptions& options, CaseResult& result) {
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(signal.samples.data());
+    const size_t inputBytes = signal.samples.size() * sizeof(uint16_t);
+    std::vector<uint8_t> decoded(inputBytes);
+
+    DHCParallel codec(workers);
+    if (!codec.set_block_samples(options.blockSamples)) {
+        return false;
+    }
+    std::vector<uint8_t> compressed(codec.compress_bound(inputBytes));
+    for (int rep = 0; rep < options.reps; rep++) {
+        size_t compressedSize = compressed.size();
+        double start = nowSeconds();
+        if (!codec.compress(input, inputBytes, compressed.data(), &compressedSize)) {
+            fprintf(stderr, "%s/%u: compress failed\n", signal.name.c_str(), workers);
+            return false;
+        }
+        result.compressSeconds = std::min(result.compressSeconds, nowSeconds() - start);
+
+        size_t decodedSize = decoded.size();
+        start = nowSeconds();
+        bool ok = codec.decompress(compressed.data(), compressedSize, decoded.data(), &decodedSize);
+        result.decompressSeconds = std::min(result.decompressSeconds, nowSeconds() - start);
+        if (!ok || decodedSize != inputBytes || memcmp(decoded.data(), input, inputBytes) != 0) {
+            fprintf(stderr, "%s/%u: round trip mismatch\n", signal.name.c_str(), workers);
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    printf("samples per signal: %zu, repetitions: %d, block: %zu, cores: %u\n", options.samples, options.reps,
+           options.blockSamples, std::thread::hardware_concurrency());
+    printf("%-12s %7s %9s %8s %9s %8s\n", "", "", "compress", "", "decomp", "");
+    printf("%-12s %7s %9s %8s %9s %8s\n", "signal", "workers", "MB/s", "speedup", "MB/s", "speedup");
+
+    bool ok = true;
+    for (const BenchSignal& signal : makeBenchSignals(options.samples)) {
+        const double inputMB = signal.samples.size() * sizeof(uint16_t) / 1e6;
+        CaseResult base;
+        for (size_t i = 0; i < options.workers.size(); i++) {
+            CaseResult result;
+            if (!runCase(signal, options.workers[i], options, result)) {
+                ok = false;
+                continue;
+            }
+            if (i == 0) base = result;
+            printf("%-12s %7u %9.1f %8.2f %9.1f %8.2f\n", signal.name.c_str(), options.workers[i],
+                   inputMB / result.compressSeconds, base.compressSeconds / result.compressSeconds,
+                   inputMB / result.decompressSeconds, base.decompressSeconds / result.decompressSeconds);
+        }
+    }
+    return ok ? 0 : 1;
+}
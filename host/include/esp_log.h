@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for ESP-IDF logging: errors and warnings go to stderr,
+// info is printed only when DHC_HOST_LOG_INFO is defined.
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...) fprintf(stderr, "E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) fprintf(stderr, "W %s: " format "\n", tag, ##__VA_ARGS__)
+
+#ifdef DHC_HOST_LOG_INFO
+#define ESP_LOGI(tag, format, ...) fprintf(stderr, "I %s: " format "\n", tag, ##__VA_ARGS__)
+#else
+#define ESP_LOGI(tag, format, ...) do {} while (0)
+#endif
+
+#define ESP_LOGD(tag, format, ...) do {} while (0)
+#define ESP_LOGV(tag, format, ...) do {} while (0)
@@ -0,0 +1,671 @@
+// dhc: command-line front end of the DHC codec for Linux.
+//
+//   dhc compress   [options] PATH...  raw recordings to DHC buffers (NAME.dhc)
+//   dhc decompress [options] PATH...  DHC buffers, streams and files back to samples (NAME.raw)
+//   dhc verify     [options] PATH...  checks that compressed inputs decode completely
+//   dhc stats      [options] PATH...  block types, predictors and table overhead
+//
+// Inputs are memory-mapped and handed to the codec in one piece, without
+// intermediate read buffers. Directories are searched recursively, and files
+// are processed concurrently, one DHC codec per worker thread; every file's
+// sizes, ratio and throughput are reported in input order as they finish.
+#include "dhc.h"
+#include "dhc_base64.h"
+#include "dhc_batch.h"
+#include "dhc_predictor.h"
+#include "dhc_samples.h"
+#include "dhc_stream.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const char* const BLOCK_TYPE_NAMES[DHC::BLOCK_TYPES] = {"dynamic", "static", "reuse", "rice", "stored"};
+const char* const CONTAINER_NAMES[] = {"buffer", "stream", "file", "batch"};
+
+enum Command { COMMAND_COMPRESS, COMMAND_DECOMPRESS, COMMAND_VERIFY, COMMAND_STATS };
+
+struct CliOptions {
+    Command command = COMMAND_COMPRESS;
+    unsigned jobs = 0;  // 0: one per core
+    std::string outputDir;
+    unsigned channels = 1;
+    unsigned bits = 16;
+    uint8_t formatFlags = 0;
+    DHC::Engine engine = DHC::ENGINE_AUTO;
+    unsigned predictor = DHC::PREDICTOR_AUTO;
+    size_t blockSamples = DHC::MAX_BLOCK_SAMPLES;
+    bool tableReuse = false;
+    bool raw = false;
+    std::vector<std::string> paths;
+};
+
+void printUsage(const char* argv0) {
+    printf("usage: %s compress|decompress|verify|stats [options] PATH...\n", argv0);
+    printf("  -j N             files processed at once (default: one per core)\n");
+    printf("  -o DIR           output directory (default: next to each input)\n");
+    printf("compress and verify --raw:\n");
+    printf("  --channels N     interleaved channels, 1..%u (default 1)\n", DHC::MAX_CHANNELS);
+    printf("  --bits N         bits per sample: 8, 12, 16, 24 or 32 (default 16)\n");
+    printf("  --signed         signed samples\n");
+    printf("  --big-endian     big-endian samples\n");
+    printf("  --engine E       auto, huffman or rice (default auto)\n");
+    printf("  --predictor P    auto or 0..4 (default auto)\n");
+    printf("  --block N        frames per block, 1..%u (default %u)\n", (unsigned)DHC::MAX_BLOCK_SAMPLES,
+           (unsigned)DHC::MAX_BLOCK_SAMPLES);
+    printf("  --table-reuse    keep code tables across blocks\n");
+    printf("verify:\n");
+    printf("  --raw            inputs are raw recordings: compress, decompress and compare\n");
+    printf("Directories are searched recursively: compress and verify --raw take every file\n");
+    printf("but *.dhc, the others only *.dhc. Raw files ending in .txt are base64 text.\n");
+}
+
+bool parseOptions(int argc, char** argv, CliOptions& options) {
+    if (argc < 2) return false;
+    std::string command = argv[1];
+    if (command == "compress") {
+        options.command = COMMAND_COMPRESS;
+    } else if (command == "decompress") {
+        options.command = COMMAND_DECOMPRESS;
+    } else if (command == "verify") {
+        options.command = COMMAND_VERIFY;
+    } else if (command == "stats") {
+        options.command = COMMAND_STATS;
+    } else {
+        return false;
+    }
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.jobs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.outputDir = argv[++i];
+        } else if (arg == "--channels" && i + 1 < argc) {
+            options.channels = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--bits" && i + 1 < argc) {
+            options.bits = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--signed") {
+            options.formatFlags |= DHC::SAMPLE_SIGNED;
+        } else if (arg == "--big-endian") {
+            options.formatFlags |= DHC::SAMPLE_BIG_ENDIAN;
+        } else if (arg == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine == "auto") {
+                options.engine = DHC::ENGINE_AUTO;
+            } else if (engine == "huffman") {
+                options.engine = DHC::ENGINE_HUFFMAN;
+            } else if (engine == "rice") {
+                options.engine = DHC::ENGINE_RICE;
+            } else {
+                return false;
+            }
+        } else if (arg == "--predictor" && i + 1 < argc) {
+            std::string predictor = argv[++i];
+            options.predictor = predictor == "auto" ? DHC::PREDICTOR_AUTO : strtoul(predictor.c_str(), nullptr, 10);
+        } else if (arg == "--block" && i + 1 < argc) {
+            options.blockSamples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--table-reuse") {
+            options.tableReuse = true;
+        } else if (arg == "--raw") {
+            options.raw = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            options.paths.push_back(arg);
+        }
+    }
+    return !options.paths.empty() && options.blockSamples > 0 && options.blockSamples <= DHC::MAX_BLOCK_SAMPLES;
+}
+
+bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+// Input files, with the name their output gets below -o: the path below the
+// directory that was named, or the file name
+struct InputFile {
+    std::string path;
+    std::string relative;
+};
+
+bool takesCompressed(const CliOptions& options) {
+    return options.command != COMMAND_COMPRESS && !(options.command == COMMAND_VERIFY && options.raw);
+}
+
+void scanDirectory(const std::string& dir, const std::string& relative, bool compressed,
+                   std::vector<InputFile>& files) {
+    DIR* handle = opendir(dir.c_str());
+    if (!handle) return;
+    std::vector<std::string> names;
+    while (dirent* entry = readdir(handle)) {
+        if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+    }
+    closedir(handle);
+    std::sort(names.begin(), names.end());
+    for (const std::string& name : names) {
+        std::string path = dir + "/" + name;
+        std::string below = relative.empty() ? name : relative + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) continue;
+        if (S_ISDIR(info.st_mode)) {
+            scanDirectory(path, below, compressed, files);
+        } else if (S_ISREG(info.st_mode) && endsWith(name, ".dhc") == compressed) {
+            files.push_back(InputFile{path, below});
+        }
+    }
+}
+
+bool collectInputs(const CliOptions& options, std::vector<InputFile>& files) {
+    for (const std::string& path : options.paths) {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0) {
+            fprintf(stderr, "cannot open %s\n", path.c_str());
+            return false;
+        }
+        if (S_ISDIR(info.st_mode)) {
+            scanDirectory(path, "", takesCompressed(options), files);
+        } else {
+            size_t slash = path.rfind('/');
+            files.push_back(InputFile{path, slash == std::string::npos ? path : path.substr(slash + 1)});
+        }
+    }
+    return true;
+}
+
+// Read-only mapping of a whole file; empty files map to nothing
+class MappedFile {
+public:
+    ~MappedFile() {
+        if (mapping) munmap(mapping, length);
+    }
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        length = ok ? static_cast<size_t>(info.st_size) : 0;
+        if (ok && length > 0) {
+            mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapping != MAP_FAILED;
+            if (ok) {
+                madvise(mapping, length, MADV_SEQUENTIAL);
+            } else {
+                mapping = nullptr;
+            }
+        }
+        close(fd);
+        return ok;
+    }
+    const uint8_t* data() const { return static_cast<const uint8_t*>(mapping); }
+    size_t size() const { return length; }
+
+private:
+    void* mapping = nullptr;
+    size_t length = 0;
+};
+
+// What the blocks of a container hold
+struct BlockSummary {
+    size_t blocks = 0;
+    uint64_t samples = 0;  // of all lanes
+    size_t types[DHC::BLOCK_TYPES] = {};
+    size_t predictors[DHC_MAX_PREDICTOR_ORDER + 1] = {};
+    uint64_t headerBytes = 0;
+    uint64_t tableBytes = 0;  // code tables and table or parameter bytes
+    uint64_t payloadBytes = 0;
+    uint64_t blockBytes = 0;  // all of the above
+};
+
+// Adds the blocks in [data, data + size) to summary; false unless they are
+// whole blocks
+bool summarizeBlocks(const DHC& codec, const uint8_t* data, size_t size, BlockSummary& summary) {
+    for (size_t pos = 0; pos < size;) {
+        DHC::BlockInfo block;
+        if (!codec.block_info(data + pos, size - pos, &block)) return false;
+        summary.blocks++;
+        summary.samples += block.samples;
+        summary.types[block.type]++;
+        summary.predictors[block.predictor]++;
+        summary.headerBytes += block.length - block.tableBytes - block.payloadBytes;
+        summary.tableBytes += block.tableBytes;
+        summary.payloadBytes += block.payloadBytes;
+        summary.blockBytes += block.length;
+        pos += block.length;
+    }
+    return true;
+}
+
+// Layout of a compressed input
+struct Container {
+    DHC::ContainerInfo info;
+    size_t records = 0;  // batches
+    BlockSummary summary;
+    uint64_t containerBytes = 0;  // magic, headers, index, batch table and lengths
+    size_t decodedBytes = 0;
+};
+
+// Batches are opened with batch, which then serves their records
+bool readContainer(const DHC& codec, DHCBatchDecoder& batch, const uint8_t* data, size_t size,
+                   Container& container) {
+    const DHC::ContainerInfo& info = container.info;
+    if (!DHC::inspect(data, size, &container.info)) return false;
+    if (info.container == DHC::CONTAINER_BATCH) {
+        if (!batch.open(data, size)) return false;
+        container.records = batch.record_count();
+        for (size_t i = 0; i < container.records; i++) {
+            const uint8_t* blocks;
+            size_t length;
+            if (!batch.record_blocks(i, &blocks, &length) ||
+                !summarizeBlocks(codec, blocks, length, container.summary)) {
+                return false;
+            }
+        }
+    } else if (!summarizeBlocks(codec, data + info.blocksBegin, info.blocksEnd - info.blocksBegin,
+                                container.summary)) {
+        return false;
+    }
+    container.containerBytes = size - container.summary.blockBytes;
+    uint64_t samples = container.summary.samples / dhcSamplePlanes(info.sampleFormat);
+    container.decodedBytes = dhcSampleBytes(info.sampleFormat, samples);
+    return true;
+}
+
+struct FileResult {
+    bool ok = false;
+    std::string error;          // ours; the codec logs its own reasons
+    uint64_t rawBytes = 0;      // uncompressed side
+    uint64_t packedBytes = 0;   // compressed side
+    double seconds = 0;
+    std::string detail;         // stats lines
+};
+
+bool writeFile(const std::string& path, const uint8_t* data, size_t size) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+// Output path for an input: NAME.dhc when compressing, NAME.raw (without a
+// .dhc suffix) when decompressing, under -o keeping the input's relative path
+std::string outputPath(const CliOptions& options, const InputFile& input) {
+    std::string name = options.outputDir.empty() ? input.path : options.outputDir + "/" + input.relative;
+    if (options.command == COMMAND_COMPRESS) return name + ".dhc";
+    if (endsWith(name, ".dhc")) name.resize(name.size() - 4);
+    return name + ".raw";
+}
+
+bool makeParentDirs(const std::string& path) {
+    for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        std::string dir = path.substr(0, slash);
+        if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST) return false;
+    }
+    return true;
+}
+
+class Worker {
+public:
+    explicit Worker(const CliOptions& options) : options(options) {}
+
+    bool configure() {
+        uint8_t format = static_cast<uint8_t>(options.bits | options.formatFlags);
+        if (!codec.set_channels(options.channels) || !codec.set_sample_format(format) ||
+            !codec.set_predictor(options.predictor)) {
+            return false;
+        }
+        codec.set_engine(options.engine);
+        codec.set_table_reuse(options.tableReuse);
+        if (options.blockSamples < DHC::MAX_BLOCK_SAMPLES) {
+            workspace.resize(DHC::workspace_size(options.blockSamples));
+        }
+        return true;
+    }
+
+    FileResult run(const InputFile& input) {
+        FileResult result;
+        MappedFile mapped;
+        if (!mapped.open(input.path)) {
+            result.error = "cannot read";
+            return result;
+        }
+        switch (options.command) {
+        case COMMAND_COMPRESS:
+            compressFile(input, mapped, result);
+            break;
+        case COMMAND_DECOMPRESS:
+            decodeFile(input, mapped, true, result);
+            break;
+        case COMMAND_VERIFY:
+            if (options.raw) {
+                roundTrip(input, mapped, result);
+            } else {
+                decodeFile(input, mapped, false, result);
+            }
+            break;
+        case COMMAND_STATS:
+            summarize(mapped, result);
+            break;
+        }
+        return result;
+    }
+
+private:
+    const CliOptions& options;
+    DHC codec;
+    DHCBatchDecoder batch;
+    std::vector<uint8_t> workspace;
+    std::vector<uint8_t> decodedText;
+    std::vector<uint8_t> packed;
+    std::vector<uint8_t> unpacked;
+
+    // Raw samples of an input: the mapping itself, or decoded base64 text
+    bool rawInput(const InputFile& input, const MappedFile& mapped, const uint8_t** data, size_t* size) {
+        if (endsWith(input.path, ".txt")) {
+            if (!dhcBase64Decode(reinterpret_cast<const char*>(mapped.data()), mapped.size(), decodedText)) {
+                return false;
+            }
+            *data = decodedText.data();
+            *size = decodedText.size();
+        } else {
+            *data = mapped.data();
+            *size = mapped.size();
+        }
+        return true;
+    }
+
+    bool compressRaw(const uint8_t* data, size_t size) {
+        packed.resize(codec.compress_bound(size, options.blockSamples));
+        size_t packedSize = packed.size();
+        bool ok = workspace.empty() ? codec.compress(data, size, packed.data(), &packedSize)
+                                    : codec.compress(data, size, packed.data(), &packedSize, workspace.data(),
+                                                     workspace.size());
+        packed.resize(ok ? packedSize : 0);
+        return ok;
+    }
+
+    void compressFile(const InputFile& input, const MappedFile& mapped, FileResult& result) {
+        const uint8_t* data;
+        size_t size;
+        if (!rawInput(input, mapped, &data, &size)) {
+            result.error = "invalid base64";
+            return;
+        }
+        result.rawBytes = size;
+        if (!compressRaw(data, size)) {
+            result.error = size == 0 ? "empty" : "compression failed";
+            return;
+        }
+        result.packedBytes = packed.size();
+        std::string path = outputPath(options, input);
+        if (!makeParentDirs(path) || !writeFile(path, packed.data(), packed.size())) {
+            result.error = "cannot write " + path;
+            return;
+        }
+        result.ok = true;
+    }
+
+    // Decodes a whole container into unpacked
+    bool decodeContainer(const MappedFile& mapped, const Container& container, FileResult& result) {
+        const uint8_t* data = mapped.data();
+        const size_t size = mapped.size();
+        unpacked.clear();
+        switch (container.info.container) {
+        case DHC::CONTAINER_BUFFER:
+        case DHC::CONTAINER_FILE: {
+            unpacked.resize(container.decodedBytes);
+            size_t decoded = unpacked.size();
+            if (!codec.decompress(data, size, unpacked.data(), &decoded) || decoded != unpacked.size()) {
+                result.error = "decoding failed";
+                return false;
+            }
+            return true;
+        }
+        case DHC::CONTAINER_STREAM: {
+            DHCStreamDecoder decoder;
+            unpacked.resize(container.decodedBytes);
+            if (!decoder.push(data, size) || decoder.pull_bytes(unpacked.data(), unpacked.size()) != unpacked.size()) {
+                result.error = "decoding failed";
+                return false;
+            }
+            return true;
+        }
+        case DHC::CONTAINER_BATCH: {
+            // Every record on its own, from the batch readContainer() opened
+            for (size_t i = 0; i < batch.record_count(); i++) {
+                size_t start = unpacked.size();
+                unpacked.resize(start + batch.record_size(i));
+                size_t decoded = unpacked.size() - start;
+                if (!batch.decompress(i, unpacked.data() + start, &decoded)) {
+                    result.error = "decoding of record " + std::to_string(i) + " failed";
+                    return false;
+                }
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    void decodeFile(const InputFile& input, const MappedFile& mapped, bool write, FileResult& result) {
+        Container container;
+        result.packedBytes = mapped.size();
+        if (!readContainer(codec, batch, mapped.data(), mapped.size(), container)) {
+            result.error = "not a complete DHC buffer, stream, file or batch";
+            return;
+        }
+        result.rawBytes = container.decodedBytes;
+        if (write && container.info.container == DHC::CONTAINER_BATCH) {
+            result.error = "batches hold separate records; see verify and stats";
+            return;
+        }
+        std::string path = write ? outputPath(options, input) : std::string();
+        if (write && !makeParentDirs(path)) {
+            result.error = "cannot write " + path;
+            return;
+        }
+        if (!decodeContainer(mapped, container, result)) {
+            return;
+        }
+        if (write && !writeFile(path, unpacked.data(), unpacked.size())) {
+            result.error = "cannot write " + path;
+            return;
+        }
+        result.ok = true;
+    }
+
+    void roundTrip(const InputFile& input, const MappedFile& mapped, FileResult& result) {
+        const uint8_t* data;
+        size_t size;
+        if (!rawInput(input, mapped, &data, &size)) {
+            result.error = "invalid base64";
+            return;
+        }
+        result.rawBytes = size;
+        if (!compressRaw(data, size)) {
+            result.error = size == 0 ? "empty" : "compression failed";
+            return;
+        }
+        result.packedBytes = packed.size();
+        unpacked.resize(size);
+        size_t decoded = size;
+        if (!codec.decompress(packed.data(), packed.size(), unpacked.data(), &decoded)) {
+            result.error = "decoding failed";
+            return;
+        }
+        if (decoded != size || memcmp(unpacked.data(), data, size) != 0) {
+            result.error = "decoded samples differ";
+            return;
+        }
+        result.ok = true;
+    }
+
+    void summarize(const MappedFile& mapped, FileResult& result) {
+        Container container;
+        result.packedBytes = mapped.size();
+        if (!readContainer(codec, batch, mapped.data(), mapped.size(), container)) {
+            result.error = "not a complete DHC buffer, stream, file or batch";
+            return;
+        }
+        result.rawBytes = container.decodedBytes;
+        const DHC::ContainerInfo& info = container.info;
+        const BlockSummary& summary = container.summary;
+        char line[256];
+        snprintf(line, sizeof(line), "  %s, %u channel%s, %u-bit%s%s, %zu blocks, %llu samples",
+                 CONTAINER_NAMES[info.container], info.channels, info.channels > 1 ? "s" : "",
+                 dhcSampleBits(info.sampleFormat), info.sampleFormat & DHC::SAMPLE_SIGNED ? " signed" : "",
+                 info.sampleFormat & DHC::SAMPLE_BIG_ENDIAN ? " big-endian" : "", summary.blocks,
+                 static_cast<unsigned long long>(summary.samples));
+        result.detail = line;
+        if (container.info.container == DHC::CONTAINER_BATCH) {
+            snprintf(line, sizeof(line), ", %zu records", container.records);
+            result.detail += line;
+        }
+        result.detail += "\n  types:";
+        for (unsigned type = 0; type < DHC::BLOCK_TYPES; type++) {
+            snprintf(line, sizeof(line), " %s %zu", BLOCK_TYPE_NAMES[type], summary.types[type]);
+            result.detail += line;
+        }
+        result.detail += "\n  predictors:";
+        for (unsigned order = 0; order <= DHC_MAX_PREDICTOR_ORDER; order++) {
+            snprintf(line, sizeof(line), " %u:%zu", order, summary.predictors[order]);
+            result.detail += line;
+        }
+        snprintf(line, sizeof(line), "\n  bytes: container %llu, block headers %llu, tables %llu, payload %llu\n",
+                 static_cast<unsigned long long>(container.containerBytes),
+                 static_cast<unsigned long long>(summary.headerBytes),
+                 static_cast<unsigned long long>(summary.tableBytes),
+                 static_cast<unsigned long long>(summary.payloadBytes));
+        result.detail += line;
+        result.ok = true;
+    }
+};
+
+// Results are printed in input order, each as soon as it and all before it are done
+class Reporter {
+public:
+    Reporter(const std::vector<InputFile>& files, bool timed) : files(files), results(files.size()), timed(timed) {
+        done.assign(files.size(), false);
+    }
+
+    void finish(size_t index, const FileResult& result) {
+        std::lock_guard<std::mutex> guard(lock);
+        results[index] = result;
+        done[index] = true;
+        while (printed < files.size() && done[printed]) {
+            print(printed++);
+        }
+    }
+
+    bool totals(double seconds) const {
+        uint64_t raw = 0, packedBytes = 0;
+        size_t failed = 0;
+        for (const FileResult& result : results) {
+            raw += result.rawBytes;
+            packedBytes += result.packedBytes;
+            failed += result.ok ? 0 : 1;
+        }
+        printf("%zu files, %zu failed: %llu -> %llu bytes, ratio %.3f", files.size(), failed,
+               static_cast<unsigned long long>(raw), static_cast<unsigned long long>(packedBytes),
+               raw ? static_cast<double>(packedBytes) / raw : 0.0);
+        if (timed) {
+            printf(", %.3f s, %.1f MB/s", seconds, seconds > 0 ? raw / seconds / 1e6 : 0.0);
+        }
+        printf("\n");
+        return failed == 0;
+    }
+
+private:
+    void print(size_t index) {
+        const FileResult& result = results[index];
+        printf("%-40s %12llu %12llu", files[index].path.c_str(), static_cast<unsigned long long>(result.rawBytes),
+               static_cast<unsigned long long>(result.packedBytes));
+        if (!result.ok) {
+            printf("  FAILED: %s\n", result.error.c_str());
+        } else if (!timed) {
+            printf("  ratio %.3f\n%s", result.rawBytes ? static_cast<double>(result.packedBytes) / result.rawBytes : 0.0,
+                   result.detail.c_str());
+        } else {
+            printf("  ratio %.3f  %8.2f ms  %8.1f MB/s\n",
+                   result.rawBytes ? static_cast<double>(result.packedBytes) / result.rawBytes : 0.0,
+                   result.seconds * 1e3, result.seconds > 0 ? result.rawBytes / result.seconds / 1e6 : 0.0);
+        }
+        fflush(stdout);
+    }
+
+    const std::vector<InputFile>& files;
+    std::vector<FileResult> results;
+    std::vector<bool> done;
+    size_t printed = 0;
+    bool timed;
+    std::mutex lock;
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    std::vector<InputFile> files;
+    if (!collectInputs(options, files)) {
+        return 1;
+    }
+    if (files.empty()) {
+        fprintf(stderr, "no input files\n");
+        return 1;
+    }
+
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, files.size()));
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (unsigned i = 0; i < jobs; i++) {
+        workers.emplace_back(new Worker(options));
+        if (!workers.back()->configure()) {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Workers take the next file until none are left
+    printf("%-40s %12s %12s\n", "file", "raw bytes", "dhc bytes");
+    Reporter reporter(files, options.command != COMMAND_STATS);
+    std::atomic<size_t> next(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (std::unique_ptr<Worker>& worker : workers) {
+        Worker* owner = worker.get();
+        threads.emplace_back([&files, &reporter, &next, owner]() {
+            for (size_t index = next++; index < files.size(); index = next++) {
+                auto begin = std::chrono::steady_clock::now();
+                FileResult result = owner->run(files[index]);
+                result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+                reporter.finish(index, result);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return reporter.totals(seconds) ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+// Trains a static DHC Huffman table from a corpus of recordings.
+//
+// Every file is cut into blocks the way the device feeds DHC::compress, in the
+// channel count and sample format of the recordings; the residuals of every
+// channel and plane are predicted as the codec does and counted by alphabet
+// symbol, and every symbol gets a code, including those the corpus never used. The result is written
+// either as C++ source for components/dhc/dhc_static_tables.cpp (embedded,
+// constexpr) or as serialized table bytes for DHC::load_static_table().
+#include "dhc.h"
+#include "dhc_base64.h"
+#include "dhc_huffman.h"
+#include "dhc_predictor.h"
+#include "dhc_static_tables.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct TrainOptions {
+    size_t blockSamples = 512;
+    unsigned channels = 1;
+    unsigned bits = 16;
+    uint8_t formatFlags = 0;
+    unsigned predictor = DHC::PREDICTOR_AUTO;
+    unsigned maxLength = 15;
+    int id = 1;
+    std::string name = "corpus";
+    bool binary = false;
+    std::string output;
+    std::vector<std::string> inputs;
+};
+
+void printUsage(const char* argv0) {
+    printf("usage: %s [options] -o OUTPUT FILE...\n", argv0);
+    printf("  --block N      frames per block, as used on the device (default 512)\n");
+    printf("  --channels N   interleaved channels, 1..%u (default 1)\n", DHC::MAX_CHANNELS);
+    printf("  --bits N       bits per sample: 8, 12, 16, 24 or 32 (default 16)\n");
+    printf("  --signed       signed samples\n");
+    printf("  --big-endian   big-endian samples\n");
+    printf("  --predictor P  auto or 0..4, as set on the device (default auto)\n");
+    printf("  --max-length N longest code length, 8..%u (default 15)\n", STATIC_TABLE_MAX_LENGTH);
+    printf("  --id N         table ID, 1..255 (default 1)\n");
+    printf("  --name NAME    table name in the generated source (default corpus)\n");
+    printf("  --binary       write serialized table bytes instead of C++ source\n");
+    printf("Files ending in .txt are base64 text, anything else raw samples.\n");
+}
+
+bool parseOptions(int argc, char** argv, TrainOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--block" && i + 1 < argc) {
+            options.blockSamples = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--channels" && i + 1 < argc) {
+            options.channels = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--bits" && i + 1 < argc) {
+            options.bits = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--signed") {
+            options.formatFlags |= DHC::SAMPLE_SIGNED;
+        } else if (arg == "--big-endian") {
+            options.formatFlags |= DHC::SAMPLE_BIG_ENDIAN;
+        } else if (arg == "--predictor" && i + 1 < argc) {
+            std::string predictor = argv[++i];
+            options.predictor = predictor == "auto" ? DHC::PREDICTOR_AUTO : strtoul(predictor.c_str(), nullptr, 10);
+        } else if (arg == "--max-length" && i + 1 < argc) {
+            options.maxLength = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--id" && i + 1 < argc) {
+            options.id = atoi(argv[++i]);
+        } else if (arg == "--name" && i + 1 < argc) {
+            options.name = argv[++i];
+        } else if (arg == "--binary") {
+            options.binary = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (!arg.empty() && arg[0] == '-') {
+            return false;
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+    return options.blockSamples > 0 && options.blockSamples <= DHC::MAX_BLOCK_SAMPLES && options.channels > 0 &&
+           options.channels <= DHC::MAX_CHANNELS &&
+           (options.predictor == DHC::PREDICTOR_AUTO || options.predictor <= DHC_MAX_PREDICTOR_ORDER) &&
+           options.maxLength >= 8 && options.maxLength <= STATIC_TABLE_MAX_LENGTH &&
+           options.id >= 1 && options.id <= 255 && !options.output.empty() && !options.inputs.empty();
+}
+
+bool readFile(const std::string& path, std::vector<uint8_t>& data) {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    uint8_t buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + n);
+    }
+    fclose(file);
+    return true;
+}
+
+struct Symbol {
+    uint8_t value;
+    uint32_t frequency;
+    uint32_t length;
+};
+
+// Code lengths for the chosen symbols, the longest capped at maxLength bits
+void assignLengths(std::vector<Symbol>& symbols, unsigned maxLength) {
+    std::vector<size_t> order(symbols.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return symbols[a].frequency < symbols[b].frequency;
+    });
+    std::vector<uint32_t> weights(order.size());
+    for (size_t i = 0; i < order.size(); i++) weights[i] = std::max<uint32_t>(symbols[order[i]].frequency, 1);
+    huffmanCodeLengths(weights.data(), weights.size());
+    huffmanLimitCodeLengths(weights.data(), weights.size(), maxLength);
+    for (size_t i = 0; i < order.size(); i++) symbols[order[i]].length = weights[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    TrainOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage(argv[0]);
+        return 2;
+    }
+
+    const uint8_t format = static_cast<uint8_t>(options.bits | options.formatFlags);
+    const unsigned planes = dhcSamplePlanes(format);
+    const DhcSampleCoder* coders[DHC_MAX_SAMPLE_PLANES] = {};
+    for (unsigned plane = 0; plane < planes; plane++) {
+        coders[plane] = dhcSampleCoder(format, plane);
+        if (!coders[plane]) {
+            fprintf(stderr, "unsupported sample format\n");
+            return 2;
+        }
+    }
+
+    // Histogram of block residuals over the whole corpus: the same block
+    // ranges, lanes and predictors as DHC::compress
+    std::vector<uint32_t> histogram(DHC_ALPHABET_SIZE, 0);
+    std::vector<int16_t> residuals(options.blockSamples);
+    size_t totalSamples = 0;
+    for (const std::string& path : options.inputs) {
+        std::vector<uint8_t> data;
+        if (!readFile(path, data)) {
+            fprintf(stderr, "cannot read %s\n", path.c_str());
+            return 1;
+        }
+        if (path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0) {
+            std::vector<uint8_t> decoded;
+            if (!dhcBase64Decode(reinterpret_cast<const char*>(data.data()), data.size(), decoded)) {
+                fprintf(stderr, "invalid base64 in %s\n", path.c_str());
+                return 1;
+            }
+            data.swap(decoded);
+        }
+        const size_t frames = dhcSampleCount(format, data.size()) / options.channels;
+        if (dhcSampleBytes(format, frames * options.channels) != data.size()) {
+            fprintf(stderr, "%s is not a whole number of %u-channel frames of %u-bit samples\n", path.c_str(),
+                    options.channels, options.bits);
+            return 1;
+        }
+        for (size_t first = 0; first < frames; first += options.blockSamples) {
+            size_t count = std::min(options.blockSamples, frames - first);
+            for (unsigned lane = 0; lane < options.channels * planes; lane++) {
+                const DhcSampleCoder& coder = *coders[lane % planes];
+                size_t start = first * options.channels + lane / planes;
+                unsigned order = options.predictor != DHC::PREDICTOR_AUTO
+                                     ? options.predictor
+                                     : coder.choosePredictor(data.data(), start, count, options.channels);
+                coder.predict(data.data(), start, count, options.channels, 0, order, residuals.data());
+                for (size_t i = 0; i < count; i++) {
+                    histogram[dhcDeltaSymbol(residuals[i])]++;
+                }
+            }
+        }
+        totalSamples += frames * options.channels * planes;
+    }
+    if (totalSamples == 0) {
+        fprintf(stderr, "empty corpus\n");
+        return 1;
+    }
+
+    // Every symbol gets a code, so that any delta can be coded
+    std::vector<Symbol> symbols;
+    for (unsigned v = 0; v < DHC_ALPHABET_SIZE; v++) {
+        symbols.push_back(Symbol{static_cast<uint8_t>(v), histogram[v], 0});
+    }
+    assignLengths(symbols, options.maxLength);
+
+    // Canonical order and estimated cost on the corpus
+    std::sort(symbols.begin(), symbols.end(), [](const Symbol& a, const Symbol& b) {
+        return a.length != b.length ? a.length < b.length : a.value < b.value;
+    });
+    unsigned maxLength = symbols.back().length;
+    std::vector<uint16_t> lengthCounts(maxLength + 1, 0);
+    uint64_t bits = 0;
+    for (const Symbol& symbol : symbols) {
+        lengthCounts[symbol.length]++;
+        bits += static_cast<uint64_t>(symbol.frequency) *
+                (symbol.length + dhcAlphabet.symbols[symbol.value].extraBits);
+    }
+    fprintf(stderr, "%zu samples, %zu codes, max length %u, %.3f bits/sample\n",
+            totalSamples, symbols.size(), maxLength, static_cast<double>(bits) / totalSamples);
+
+    FILE* out = fopen(options.output.c_str(), options.binary ? "wb" : "w");
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", options.output.c_str());
+        return 1;
+    }
+    if (options.binary) {
+        // Same layout as the code table of a dynamic block
+        fputc(static_cast<int>(maxLength), out);
+        for (unsigned len = 1; len <= maxLength; len++) {
+            fputc(lengthCounts[len] >> 8, out);
+            fputc(lengthCounts[len] & 0xFF, out);
+        }
+        for (const Symbol& symbol : symbols) {
+            fputc(symbol.value, out);
+        }
+    } else {
+        fprintf(out, "// Generated by dhc_train:");
+        for (int i = 1; i < argc; i++) fprintf(out, " %s", argv[i]);
+        fprintf(out, "\n// %zu samples, %.3f bits/sample on the training corpus\n",
+                totalSamples, static_cast<double>(bits) / totalSamples);
+        fprintf(out, "#include \"dhc_static_tables.h\"\n\n");
+        fprintf(out, "static constexpr uint16_t k%sLengthCounts[] = {", options.name.c_str());
+        for (unsigned len = 1; len <= maxLength; len++) {
+            fprintf(out, "%s%u", len == 1 ? "" : ", ", lengthCounts[len]);
+        }
+        fprintf(out, "};\n\n");
+        fprintf(out, "static constexpr uint8_t k%sSymbols[] = {", options.name.c_str());
+        for (size_t i = 0; i < symbols.size(); i++) {
+            fprintf(out, "%s%u", i % 16 == 0 ? "\n    " : " ", symbols[i].value);
+            if (i + 1 < symbols.size()) fputc(',', out);
+        }
+        fprintf(out, "\n};\n\n");
+        fprintf(out, "static constexpr StaticTableSpec kStaticTables[] = {\n");
+        fprintf(out, "    {%d, \"%s\", %u, k%sLengthCounts, k%sSymbols, %zu},\n", options.id,
+                options.name.c_str(), maxLength, options.name.c_str(), options.name.c_str(),
+                symbols.size());
+        fprintf(out, "};\n\n");
+        fprintf(out, "const StaticTableSpec* dhcFindStaticTable(uint8_t id) {\n");
+        fprintf(out, "    for (const StaticTableSpec& table : kStaticTables) {\n");
+        fprintf(out, "        if (table.id == id) return &table;\n");
+        fprintf(out, "    }\n");
+        fprintf(out, "    return nullptr;\n");
+        fprintf(out, "}\n");
+    }
+    fclose(out);
+    return 0;
+}
@@ -3,113 +3,64 @@
 #include "freertos/task.h"
 #include "esp_system.h"
 #include "esp_log.h"
-#include "dhc.h"
-#include <vector>
-#include <string>
-#include <sstream>
-#include <iomanip>
+#include "dhc_base64.h"
+#include <algorithm>
 #include <cstring>
-#include "mbedtls/base64.h"
 
 #define TAG "MAIN"
 
-// Function to convert base64 to binary
-bool base64_decode(const char* input, std::vector<uint8_t>& output) {
-    size_t output_len;
-    size_t input_len = strlen(input);
-    // Calculate required output buffer size
-    if(mbedtls_base64_decode(nullptr, 0, &output_len, (const unsigned char*)input, input_len) != MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL) {
-        ESP_LOGE(TAG, "Failed to calculate base64 decode length");
-        return false;
-    }
-    // Resize output vector
-    output.resize(output_len);
-    // Perform actual decoding
-    if(mbedtls_base64_decode(output.data(), output_len, &output_len, (const unsigned char*)input, input_len) != 0) {
-        ESP_LOGE(TAG, "Failed to decode base64 data");
-        return false;
-    }
-    output.resize(output_len);  // Adjust to actual size
-    return true;
+// Receives each piece of compressed base64 output as the pipeline produces it.
+// Logging every piece costs more than compressing it, so the text is only
+// logged at debug level.
+static void log_base64_output(const char* text, size_t length, void* context)
+{
+    size_t* piece = static_cast<size_t*>(context);
+    size_t index = (*piece)++;
+    ESP_LOGD(TAG, "Compressed base64 %d:\n%.*s", (int)index, (int)length, text);
 }
 
-// Function to print data in hex format
-void print_hex(const uint8_t* data, size_t len) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    
-    for(size_t i = 0; i < len; i++) {
-        ss << std::setw(2) << static_cast<int>(data[i]);
-        if((i + 1) % 16 == 0) {
-            ss << "\n";
-        } else {
-            ss << " ";
-        }
-    }
-    
-    ESP_LOGI(TAG, "\nHex dump:\n%s", ss.str().c_str());
+// One summary of the codec counters, when built with CONFIG_DHC_STATS
+static void log_stats(const DHC::Stats& stats)
+{
+    if (!DHC::STATS_ENABLED) return;
+    ESP_LOGI(TAG, "Cycles: delta %llu, histogram %llu, tree %llu, encode %llu, bit-pack %llu, I/O %llu",
+             (unsigned long long)stats.deltaTime, (unsigned long long)stats.histogramTime,
+             (unsigned long long)stats.treeTime, (unsigned long long)stats.encodeTime,
+             (unsigned long long)stats.packTime, (unsigned long long)stats.ioTime);
+    ESP_LOGI(TAG, "Blocks: %lu, bytes in %llu, out %llu, tables %lu bytes, longest code %u, heap high-water %lu",
+             (unsigned long)stats.blocks, (unsigned long long)stats.bytesIn, (unsigned long long)stats.bytesOut,
+             (unsigned long)stats.tableBytes, (unsigned)stats.longestCode, (unsigned long)stats.heapHighWater);
 }
 
 extern "C" void app_main(void)
 {
     // Writable buffer for base64 input (modifiable in code)
     static char base64_data[110000] = "";
-    static char base64_output_chunk[1200] = ""; // Output buffer for compressed base64 chunk (base64 expands by ~33%)
 
     size_t base64_len = strlen(base64_data);
-    size_t base64_pos = 0;
-    size_t chunk_index = 0;
-    DHC compressor;
-    while (base64_pos < base64_len) {
-        // Find the next chunk of base64 (must be a multiple of 4 for base64 decode)
-        size_t chunk_b64_len = 1024; // Smaller chunk for embedded RAM
-        if (base64_pos + chunk_b64_len > base64_len) {
-            chunk_b64_len = base64_len - base64_pos;
-        }
-        // Ensure chunk_b64_len is a multiple of 4
-        chunk_b64_len = (chunk_b64_len / 4) * 4;
-        if (chunk_b64_len == 0) break;
 
-        ESP_LOGI(TAG, "Decoding chunk %d: base64_pos=%d, chunk_b64_len=%d", (int)chunk_index, (int)base64_pos, (int)chunk_b64_len);
-        ESP_LOGI(TAG, "First 32 base64 chars: %.32s", &base64_data[base64_pos]);
-        ESP_LOGI(TAG, "Free heap before compression: %lu", (unsigned long)esp_get_free_heap_size());
+    // Decode, compress and re-encode in one pass. Slices may end anywhere, not
+    // only on multiples of 4, and output arrives through the callback in
+    // pieces, so nothing scales with the input length
+    static size_t piece = 0;
+    static DHCBase64Pipeline pipeline(log_base64_output, &piece);
 
-        // Decode base64 chunk to binary
-        static uint8_t binary_chunk[1024]; // Match chunk size, now static to avoid stack overflow
-        size_t binary_chunk_len = sizeof(binary_chunk);
-        int ret = mbedtls_base64_decode(binary_chunk, binary_chunk_len, &binary_chunk_len,
-                                        (const unsigned char*)&base64_data[base64_pos], chunk_b64_len);
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Base64 decode failed for chunk %d", (int)chunk_index);
-            break;
-        }
-
-        // Compress the binary chunk
-        static uint8_t compressed_chunk[1024]; // Match chunk size, now static to avoid stack overflow
-        size_t compressed_chunk_len = sizeof(compressed_chunk);
-        if (compressor.compress(binary_chunk, binary_chunk_len, compressed_chunk, &compressed_chunk_len)) {
-            // Calculate and log compression ratio
-            float compression_ratio = (float)compressed_chunk_len / (float)binary_chunk_len;
-            ESP_LOGI(TAG, "Chunk %d: Original size: %d, Compressed size: %d, Compression ratio: %.2f%%", (int)chunk_index, (int)binary_chunk_len, (int)compressed_chunk_len, compression_ratio * 100.0f);
-            // Encode compressed chunk to base64
-            size_t base64_output_chunk_len = sizeof(base64_output_chunk);
-            int enc_ret = mbedtls_base64_encode((unsigned char*)base64_output_chunk, base64_output_chunk_len, &base64_output_chunk_len,
-                                                compressed_chunk, compressed_chunk_len);
-            if (enc_ret == 0) {
-                ESP_LOGI(TAG, "Compressed chunk %d (base64):\n%s", (int)chunk_index, base64_output_chunk);
-            } else {
-                ESP_LOGE(TAG, "Base64 encoding failed for compressed chunk %d", (int)chunk_index);
-            }
-        } else {
-            ESP_LOGE(TAG, "Compression failed for chunk %d", (int)chunk_index);
-        }
-
-        base64_pos += chunk_b64_len;
-        chunk_index++;
+    const size_t slice_len = 1000;
+    bool ok = true;
+    for (size_t base64_pos = 0; base64_pos < base64_len && ok; base64_pos += slice_len) {
+        ok = pipeline.push(&base64_data[base64_pos], std::min(slice_len, base64_len - base64_pos));
     }
+    if (ok && pipeline.flush(true)) {
+        float compression_ratio = pipeline.bytes_in() > 0 ? (float)pipeline.bytes_out() / (float)pipeline.bytes_in() : 0.0f;
+        ESP_LOGI(TAG, "Original size: %d, Compressed size: %d, Compression ratio: %.2f%%", (int)pipeline.bytes_in(), (int)pipeline.bytes_out(), compression_ratio * 100.0f);
+    } else {
+        ESP_LOGE(TAG, "Compression pipeline failed");
+    }
+    log_stats(pipeline.encoder().get_stats());
+    ESP_LOGI(TAG, "Minimum free heap: %lu", (unsigned long)esp_get_minimum_free_heap_size());
 
     // Main loop
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(1000));
     }
-} 
\ No newline at end of file
+}